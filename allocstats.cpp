@@ -0,0 +1,68 @@
+#include "allocstats.h"
+#include <atomic>
+
+static std::atomic<long> growths(0);
+
+void countGrowth() {
+	growths.fetch_add(1, std::memory_order_relaxed);
+}
+
+long growthCount() {
+	return growths.load(std::memory_order_relaxed);
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<long> allocations(0);
+
+long allocationCount() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+bool allocationCounting() {
+	return true;
+}
+
+// replace the global allocation functions with ones which count
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+#else
+
+long allocationCount() {
+	return 0;
+}
+
+bool allocationCounting() {
+	return false;
+}
+
+#endif
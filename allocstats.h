@@ -0,0 +1,20 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+/**
+* Counts every operator new made by the program, to check the frame loop doesn't touch
+* the heap once it's warmed up. Only active when built with COUNT_ALLOCATIONS defined
+* (make ALLOC_CHECK=1), otherwise the count is always 0.
+*/
+long allocationCount();
+
+// whether allocations are being counted in this build
+bool allocationCounting();
+
+// notes that a buffer the program keeps (pool, arena, draw arrays) has grown to a new working
+// size. frames where this happens aren't steady state, so the allocation check lets them off.
+// counted in every build.
+void countGrowth();
+long growthCount();
+
+#endif
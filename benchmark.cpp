@@ -0,0 +1,101 @@
+#include "benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <algorithm>
+#include <fstream>
+
+BenchResult::BenchResult() {
+	this->frames = 0;
+	this->particles = 0;
+	this->totalMs = 0;
+	this->baselineMsPerFrame = -1;
+	this->allocations = -1;
+}
+
+double BenchResult::msPerFrame() {
+	return this->frames > 0 ? this->totalMs / this->frames : 0;
+}
+
+std::vector<std::string> listScenarios(const char *dir) {
+	std::vector<std::string> files;
+	DIR *d = opendir(dir);
+	if (!d) return files;
+
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		std::string file = entry->d_name;
+		if (file.size() > 4 && file.compare(file.size() - 4, 4, ".scn") == 0) {
+			files.push_back(std::string(dir) + "/" + file);
+		}
+	}
+	closedir(d);
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// finds "key": in a line and returns the text after it, or an empty string
+static std::string findValue(const std::string &line, const std::string &key) {
+	std::string search = "\"" + key + "\": ";
+	size_t pos = line.find(search);
+	if (pos == std::string::npos) return "";
+	return line.substr(pos + search.size());
+}
+
+bool loadBaseline(const char *path, std::map<std::string, double> &baseline) {
+	std::ifstream file(path);
+	if (!file) return false;
+
+	// writeResults puts each scenario on its own line, so there is no need for a full JSON parser
+	std::string line;
+	while (std::getline(file, line)) {
+		std::string name = findValue(line, "name");
+		std::string ms = findValue(line, "ms_per_frame");
+		if (name.size() < 2 || ms.empty()) continue;
+		name = name.substr(1, name.find('"', 1) - 1);
+		baseline[name] = atof(ms.c_str());
+	}
+	return true;
+}
+
+// writes a string with JSON escaping
+static void writeString(FILE *out, const std::string &s) {
+	fputc('"', out);
+	for (int i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\') fputc('\\', out);
+		fputc(s[i], out);
+	}
+	fputc('"', out);
+}
+
+bool writeResults(const char *path, std::vector<BenchResult> &results) {
+	FILE *out = std::string(path) == "-" ? stdout : fopen(path, "w");
+	if (!out) return false;
+
+	fprintf(out, "{\n  \"scenarios\": [\n");
+	for (int i = 0; i < results.size(); i++) {
+		BenchResult &r = results[i];
+		fprintf(out, "    {\"name\": ");
+		writeString(out, r.name);
+		fprintf(out, ", \"frames\": %d, \"particles\": %d, \"total_ms\": %.3f, \"ms_per_frame\": %.4f, \"stages_ms\": {",
+			r.frames, r.particles, r.totalMs, r.msPerFrame());
+		for (int s = 0; s < r.stageNames.size(); s++) {
+			if (s > 0) fprintf(out, ", ");
+			writeString(out, r.stageNames[s]);
+			fprintf(out, ": %.3f", r.stageMs[s]);
+		}
+		fprintf(out, "}");
+		if (r.allocations >= 0) fprintf(out, ", \"steady_allocations\": %ld", r.allocations);
+		// compare against the baseline if there is one for this scenario
+		if (r.baselineMsPerFrame > 0) {
+			fprintf(out, ", \"baseline_ms_per_frame\": %.4f, \"change_pct\": %.2f",
+				r.baselineMsPerFrame, ((r.msPerFrame() - r.baselineMsPerFrame) / r.baselineMsPerFrame) * 100);
+		}
+		fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+
+	if (out != stdout) fclose(out);
+	return true;
+}
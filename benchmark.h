@@ -0,0 +1,46 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+* Timings from running one scenario headless.
+*/
+class BenchResult {
+public:
+	BenchResult();
+
+	std::string name;
+	// frames run, and particle count at the end
+	int frames;
+	int particles;
+
+	// total wall time for the run
+	double totalMs;
+
+	// time spent in each stage of the frame over the whole run
+	std::vector<std::string> stageNames;
+	std::vector<double> stageMs;
+
+	// ms per frame of the same scenario in the baseline, or -1 if it has none
+	double baselineMsPerFrame;
+
+	// heap allocations made after warming up, or -1 if they weren't counted
+	long allocations;
+
+	double msPerFrame();
+};
+
+// lists the scenario files (*.scn) in a directory, in alphabetical order
+std::vector<std::string> listScenarios(const char *dir);
+
+// reads ms_per_frame for each scenario from a results file previously written by writeResults.
+// returns false if the file can't be read.
+bool loadBaseline(const char *path, std::map<std::string, double> &baseline);
+
+// writes results as JSON to path, or to stdout if path is "-"
+bool writeResults(const char *path, std::vector<BenchResult> &results);
+
+#endif
@@ -35,6 +35,15 @@ Camera::Camera(Vec3D camPos, Vec3D camTgt) {
 	this->pitch = 0.0;
 	this->yaw = 0.0;
 
+	// strafe direction for the initial camFront
+	this->camStrafe = camFront.cross(camUp).normalize();
+
+	// nothing has been computed yet
+	this->aspect = 1.0;
+	this->rotationDirty = true;
+	this->viewDirty = true;
+	this->projectionDirty = true;
+
 	// movement speed of the camera
 	this->camSpeed = 0.1;
 	// rotation speed of the camera
@@ -44,21 +53,84 @@ Camera::Camera(Vec3D camPos, Vec3D camTgt) {
 void Camera::setupPerspective() {
 	// load projection matrix
 	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-
-	// set up perspective with 90 fov
-	gluPerspective(90, 1.0, 0.1, 100);
+	glLoadMatrixf(projectionMatrix());
 }
 
 void Camera::lookAt() {
 	// load modelview matrix
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	glLoadMatrixf(viewMatrix());
+}
+
+void Camera::updateMatrices() {
+	if (this->projectionDirty) {
+		// same as gluPerspective(90, aspect, 0.1, 100)
+		// (with a 90 degree fov, 1/tan(fov/2) is just 1)
+		float zNear = 0.1, zFar = 100;
+		for (int i = 0; i < 16; i++) this->projection[i] = 0;
+		this->projection[0] = 1.0 / this->aspect;
+		this->projection[5] = 1.0;
+		this->projection[10] = (zFar + zNear) / (zNear - zFar);
+		this->projection[11] = -1.0;
+		this->projection[14] = (2 * zFar * zNear) / (zNear - zFar);
+	}
+
+	if (this->viewDirty) {
+		// same as gluLookAt from camPos towards camPos + camFront
+		Vec3D f = this->camFront.normalize();
+		Vec3D s = f.cross(this->up).normalize();
+		Vec3D u = s.cross(f);
+		Vec3D e = this->camPos;
+
+		this->view[0] = s.mX; this->view[4] = s.mY; this->view[8] = s.mZ;
+		this->view[1] = u.mX; this->view[5] = u.mY; this->view[9] = u.mZ;
+		this->view[2] = -f.mX; this->view[6] = -f.mY; this->view[10] = -f.mZ;
+		this->view[3] = 0; this->view[7] = 0; this->view[11] = 0;
+		this->view[12] = -((s.mX * e.mX) + (s.mY * e.mY) + (s.mZ * e.mZ));
+		this->view[13] = -((u.mX * e.mX) + (u.mY * e.mY) + (u.mZ * e.mZ));
+		this->view[14] = (f.mX * e.mX) + (f.mY * e.mY) + (f.mZ * e.mZ);
+		this->view[15] = 1;
+	}
+
+	if (this->projectionDirty || this->viewDirty) {
+		// viewProjection = projection * view
+		for (int col = 0; col < 4; col++) {
+			for (int row = 0; row < 4; row++) {
+				float sum = 0;
+				for (int k = 0; k < 4; k++) sum += this->projection[(k * 4) + row] * this->view[(col * 4) + k];
+				this->viewProjection[(col * 4) + row] = sum;
+			}
+		}
+	}
+
+	this->projectionDirty = false;
+	this->viewDirty = false;
+}
+
+const float* Camera::viewMatrix() {
+	updateMatrices();
+	return this->view;
+}
 
-	// look at the point
-	gluLookAt (this->camPos.mX, this->camPos.mY, this->camPos.mZ,
-		(this->camPos.mX + this->camFront.mX), (this->camPos.mY + this->camFront.mY), (this->camPos.mZ + this->camFront.mZ),
-		this->up.mX, this->up.mY, this->up.mZ);
+const float* Camera::projectionMatrix() {
+	updateMatrices();
+	return this->projection;
+}
+
+const float* Camera::viewProjectionMatrix() {
+	updateMatrices();
+	return this->viewProjection;
+}
+
+void Camera::setAspect(float aspect) {
+	if (aspect == this->aspect) return;
+	this->aspect = aspect;
+	this->projectionDirty = true;
+}
+
+void Camera::markDirty() {
+	this->camStrafe = this->camFront.cross(this->camUp).normalize();
+	this->viewDirty = true;
 }
 
 void Camera::updateRotation(float xoff, float yoff) {
@@ -70,9 +142,16 @@ void Camera::updateRotation(float xoff, float yoff) {
 	// adjust rotations
 	this->yaw += xoff;
 	this->pitch -= yoff;
+
+	// camFront only needs recomputing if the angles actually changed
+	if (xoff != 0 || yoff != 0) this->rotationDirty = true;
 }
 
 void Camera::applyRotation() {
+	// nothing to do if there was no mouse movement since last time
+	if (!this->rotationDirty) return;
+	this->rotationDirty = false;
+
 	// pitch is constrained because pitch gets weird outside of (-90, 90)
 	// (stuff flips upside down)
 	if (pitch > 89.0) pitch = 89.0;
@@ -84,6 +163,7 @@ void Camera::applyRotation() {
 	float mZ = cos((M_PI*this->pitch)/180) * sin((M_PI*this->yaw)/180);
 
 	this->camFront = Vec3D(mX, mY, mZ).normalize();
+	markDirty();
 }
 
 void Camera::applyMovement(bool movement[]) {
@@ -106,16 +186,31 @@ void Camera::applyMovement(bool movement[]) {
 	}
 
 	if (movement[2]) {
-		Vec3D tmp = this->camFront.cross(this->camUp).normalize().multiply(this->camSpeed);
+		Vec3D tmp = this->camStrafe.multiply(this->camSpeed);
 		this->camPos.mX -= tmp.mX;
 		this->camPos.mY -= tmp.mY;
 		this->camPos.mZ -= tmp.mZ;
 	}
 
 	if (movement[3]) {
-		Vec3D tmp = this->camFront.cross(this->camUp).normalize().multiply(this->camSpeed);
+		Vec3D tmp = this->camStrafe.multiply(this->camSpeed);
 		this->camPos.mX += tmp.mX;
 		this->camPos.mY += tmp.mY;
 		this->camPos.mZ += tmp.mZ;
 	}
+
+	if (movement[0] || movement[1] || movement[2] || movement[3]) this->viewDirty = true;
+}
+
+void Camera::clampPosition(Point3D min, Point3D max) {
+	Vec3D old = this->camPos;
+
+	if (this->camPos.mX > max.mX) this->camPos.mX = max.mX;
+	if (this->camPos.mY > max.mY) this->camPos.mY = max.mY;
+	if (this->camPos.mZ > max.mZ) this->camPos.mZ = max.mZ;
+	if (this->camPos.mX < min.mX) this->camPos.mX = min.mX;
+	if (this->camPos.mY < min.mY) this->camPos.mY = min.mY;
+	if (this->camPos.mZ < min.mZ) this->camPos.mZ = min.mZ;
+
+	if (old.mX != this->camPos.mX || old.mY != this->camPos.mY || old.mZ != this->camPos.mZ) this->viewDirty = true;
 }
\ No newline at end of file
@@ -28,6 +28,8 @@ public:
 
 	// Vector representing the front of the camera (gets rotated as needed)
 	Vec3D camFront;
+	// Vector pointing to the right of camFront, used for strafing (cached when camFront changes)
+	Vec3D camStrafe;
 
 	// Angles of rotation for the camera.
 	float pitch;
@@ -51,6 +53,37 @@ public:
 
 	// applies movements to camPos based on the input movement array.
 	void applyMovement(bool movement[]);
+
+	// keeps camPos inside the box from min to max.
+	void clampPosition(Point3D min, Point3D max);
+
+	// sets the aspect ratio (width / height) used for the projection.
+	void setAspect(float aspect);
+
+	// flags the cached view as out of date, needed after changing camPos/camFront directly.
+	void markDirty();
+
+	// cached view, projection and projection * view matrices, in the column-major order GL uses.
+	// these are only recomputed after the camera has moved/rotated or the aspect has changed.
+	const float* viewMatrix();
+	const float* projectionMatrix();
+	const float* viewProjectionMatrix();
+
+private:
+	// aspect ratio of the viewport
+	float aspect;
+
+	// what needs recomputing since the last time it was used
+	bool rotationDirty;
+	bool viewDirty;
+	bool projectionDirty;
+
+	float view[16];
+	float projection[16];
+	float viewProjection[16];
+
+	// recomputes whichever cached matrices are out of date
+	void updateMatrices();
 };
 
 #endif
\ No newline at end of file
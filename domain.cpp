@@ -0,0 +1,285 @@
+#include "particle3d.h"
+#include "particlepool.h"
+#include "transport.h"
+#include "domain.h"
+#include "framearena.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <new>
+
+SlabDomain::SlabDomain(int workers, float minX, float maxX, bool useSockets) {
+	if (workers < 1) workers = 1;
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	this->workers = workers;
+	this->minX = minX;
+	this->maxX = maxX;
+	this->useSockets = useSockets;
+	this->memory = NULL;
+	this->memorySize = 0;
+	this->control = NULL;
+	this->rings = NULL;
+	this->regions = NULL;
+	this->regionCapacity = 0;
+	this->hiddenReported = 0;
+	this->stepCount = 0;
+}
+
+SlabDomain::~SlabDomain() {
+	stop();
+}
+
+int SlabDomain::workerCount() {
+	return this->workers;
+}
+
+int SlabDomain::slabOf(float x) {
+	int slab = (int)(((x - this->minX) / (this->maxX - this->minX)) * this->workers);
+	if (slab < 0) slab = 0;
+	if (slab >= this->workers) slab = this->workers - 1;
+	return slab;
+}
+
+float SlabDomain::slabMin(int worker) {
+	return this->minX + (((this->maxX - this->minX) * worker) / this->workers);
+}
+
+float SlabDomain::slabMax(int worker) {
+	return this->minX + (((this->maxX - this->minX) * (worker + 1)) / this->workers);
+}
+
+int SlabDomain::queued() {
+	int total = 0;
+	for (int i = 0; i < this->workers; i++) total += this->control->held[i].load(std::memory_order_relaxed);
+	return total;
+}
+
+Ring* SlabDomain::ring(int from, int dir) {
+	return (Ring*)(this->rings + (((from * 2) + dir) * Ring::bytes()));
+}
+
+bool SlabDomain::start(ParticlePool &pool, StepFunc step) {
+	// leave plenty of room for particles to bunch up in one slab
+	this->regionCapacity = pool.size() * 2;
+	if (this->regionCapacity < 65536) this->regionCapacity = 65536;
+
+	// lay out the shared memory: control block, then 2 rings per worker, then published particles
+	size_t controlBytes = (sizeof(Control) + 63) & ~(size_t)63;
+	size_t ringBytes = this->useSockets ? 0 : Ring::bytes() * 2 * this->workers;
+	size_t regionBytes = sizeof(Particle3D) * this->regionCapacity * this->workers;
+	this->memorySize = controlBytes + ringBytes + regionBytes;
+
+	// an anonymous shared mapping is inherited by the forked workers
+	this->memory = mmap(NULL, this->memorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (this->memory == MAP_FAILED) {
+		perror("mmap");
+		this->memory = NULL;
+		return false;
+	}
+	this->control = new (this->memory) Control();
+	this->control->step.store(0);
+	for (int i = 0; i < this->workers; i++) {
+		this->control->sent[i].store(0);
+		this->control->held[i].store(0);
+		this->control->done[i].store(0);
+		this->control->published[i].store(0);
+		this->control->unpublished[i].store(0);
+	}
+	this->rings = (unsigned char*)this->memory + controlBytes;
+	if (!this->useSockets) {
+		for (int i = 0; i < this->workers * 2; i++) new (this->rings + (i * Ring::bytes())) Ring();
+	}
+	this->regions = (Particle3D*)((unsigned char*)this->memory + controlBytes + ringBytes);
+
+	// sockets between each pair of neighbours
+	if (this->useSockets) {
+		for (int i = 0; i + 1 < this->workers; i++) {
+			int fds[2];
+			if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0) {
+				perror("socketpair");
+				stop();
+				return false;
+			}
+			this->sockets.push_back(fds[0]);
+			this->sockets.push_back(fds[1]);
+		}
+	}
+
+	// hand out the starting particles through the published regions
+	int dropped = 0;
+	for (int i = 0; i < pool.size(); i++) {
+		int w = slabOf(pool[i].position.mX);
+		int n = this->control->published[w].load();
+		if (n < this->regionCapacity) {
+			memcpy(&this->regions[(w * this->regionCapacity) + n], &pool[i], sizeof(Particle3D));
+			this->control->published[w].store(n + 1);
+		} else {
+			dropped++;
+		}
+	}
+	if (dropped > 0) fprintf(stderr, "domain: %d particles did not fit in their slab and were dropped\n", dropped);
+
+	for (int w = 0; w < this->workers; w++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			stop();
+			return false;
+		}
+		if (pid == 0) runWorker(w, pool, step);
+		this->pids.push_back(pid);
+	}
+
+	// the workers have their own copies of the sockets now
+	for (int i = 0; i < this->sockets.size(); i++) close(this->sockets[i]);
+	this->sockets.clear();
+
+	return true;
+}
+
+void SlabDomain::runWorker(int worker, ParticlePool &pool, StepFunc step) {
+	pid_t parent = getppid();
+
+	// set up links to the neighbours either side (NULL where there is no neighbour)
+	Transport *links[2] = {NULL, NULL};
+	if (this->useSockets) {
+		// pair i joins worker i (fds[2i]) and worker i + 1 (fds[2i + 1])
+		for (int i = 0; i < this->sockets.size(); i++) {
+			if (i == (worker * 2) - 1) links[0] = new SocketTransport(this->sockets[i]);
+			else if (i == worker * 2) links[1] = new SocketTransport(this->sockets[i]);
+			else close(this->sockets[i]);
+		}
+	} else {
+		if (worker > 0) links[0] = new RingTransport(ring(worker, 0), ring(worker - 1, 1));
+		if (worker + 1 < this->workers) links[1] = new RingTransport(ring(worker, 1), ring(worker + 1, 0));
+	}
+
+	// take this worker's starting particles
+	pool.clear();
+	Particle3D *region = &this->regions[worker * this->regionCapacity];
+	int start = this->control->published[worker].load();
+	for (int i = 0; i < start; i++) pool.push_back(region[i]);
+
+	float low = slabMin(worker), high = slabMax(worker);
+	int last = 0;
+	while (true) {
+		// wait for the coordinator to start the next step
+		int s;
+		while ((s = this->control->step.load(std::memory_order_acquire)) == last) {
+			// give up if the coordinator has gone away without telling us
+			if (getppid() != parent) _exit(0);
+			usleep(50);
+		}
+		if (s < 0) break;
+		last = s;
+
+		step(worker, this->control->input);
+
+		// pass on particles which have left the slab (if a link is full they stay for a step)
+		int held = 0;
+		for (int i = 0; i < pool.size(); ) {
+			float x = pool[i].position.mX;
+			int d = x < low ? 0 : (x >= high ? 1 : -1);
+			if (d >= 0 && links[d] != NULL) {
+				if (links[d]->send(pool[i])) {
+					pool.erase(i);
+					continue;
+				}
+				held++;
+			}
+			i++;
+		}
+		this->control->held[worker].store(held, std::memory_order_relaxed);
+		this->control->sent[worker].store(s, std::memory_order_release);
+
+		// once both neighbours have sent, take in everything which crossed into this slab,
+		// so no particles are left in between slabs when publishing
+		for (int d = 0; d < 2; d++) {
+			if (links[d] == NULL) continue;
+			int neighbour = d == 0 ? worker - 1 : worker + 1;
+			while (this->control->sent[neighbour].load(std::memory_order_acquire) < s) {
+				if (getppid() != parent) _exit(0);
+				sched_yield();
+			}
+			Particle3D p;
+			while (links[d]->receive(p)) pool.push_back(p);
+		}
+
+		// publish for the coordinator to render
+		// a slab with more particles than its region still simulates them all, but only the
+		// ones which fit can be shown. the rest are counted so the coordinator can say so.
+		int n = pool.size() < this->regionCapacity ? pool.size() : this->regionCapacity;
+		for (int i = 0; i < n; i++) memcpy(&region[i], &pool[i], sizeof(Particle3D));
+		this->control->published[worker].store(n, std::memory_order_relaxed);
+		this->control->unpublished[worker].store(pool.size() - n, std::memory_order_relaxed);
+		this->control->done[worker].store(s, std::memory_order_release);
+
+		// the coordinator resets its arena each tick, workers have to do their own
+		threadArena().reset();
+	}
+
+	delete links[0];
+	delete links[1];
+	_exit(0);
+}
+
+bool SlabDomain::step(const DomainInput &input) {
+	if (this->control == NULL || this->pids.empty()) return false;
+
+	this->control->input = input;
+	this->stepCount++;
+	this->control->step.store(this->stepCount, std::memory_order_release);
+
+	// wait for every worker to finish the step
+	for (int w = 0; w < this->workers; w++) {
+		int spins = 0;
+		while (this->control->done[w].load(std::memory_order_acquire) != this->stepCount) {
+			// now and again, check the worker is still alive
+			if (++spins % 1000 == 0 && waitpid(this->pids[w], NULL, WNOHANG) != 0) {
+				fprintf(stderr, "domain worker %d has died\n", w);
+				return false;
+			}
+			sched_yield();
+		}
+	}
+	return true;
+}
+
+void SlabDomain::gather(ParticlePool &pool) {
+	pool.clear();
+	if (this->control == NULL) return;
+	int hidden = 0;
+	for (int w = 0; w < this->workers; w++) {
+		Particle3D *region = &this->regions[w * this->regionCapacity];
+		int n = this->control->published[w].load(std::memory_order_acquire);
+		for (int i = 0; i < n; i++) memcpy(pool.spawn(), &region[i], sizeof(Particle3D));
+		hidden += this->control->unpublished[w].load(std::memory_order_relaxed);
+	}
+
+	// warn when slabs start overflowing their regions, rather than every step they do
+	if (hidden > 0 && this->hiddenReported == 0) {
+		fprintf(stderr, "domain: %d particles are being simulated but don't fit in their slab's region (%d per slab) so aren't shown\n",
+			hidden, this->regionCapacity);
+	}
+	this->hiddenReported = hidden;
+}
+
+void SlabDomain::stop() {
+	if (this->control != NULL && !this->pids.empty()) {
+		this->control->step.store(-1, std::memory_order_release);
+		for (int w = 0; w < this->pids.size(); w++) waitpid(this->pids[w], NULL, 0);
+	}
+	this->pids.clear();
+
+	for (int i = 0; i < this->sockets.size(); i++) close(this->sockets[i]);
+	this->sockets.clear();
+
+	if (this->memory != NULL) munmap(this->memory, this->memorySize);
+	this->memory = NULL;
+	this->control = NULL;
+}
@@ -0,0 +1,122 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include "particle3d.h"
+#include "particlepool.h"
+#include "transport.h"
+#include <sys/types.h>
+#include <atomic>
+#include <vector>
+
+// most worker processes a domain can be split between
+const int MAX_WORKERS = 64;
+
+/**
+* Input the coordinator passes to every worker for each step.
+*/
+class DomainInput {
+public:
+	float camPos[3];
+	float camFront[3];
+	bool mouseButtons[2];
+	// whether particles get halos
+	bool halos;
+};
+
+/**
+* Splits the box into slabs along x, each simulated by its own worker process.
+* Particles which leave a slab are handed to the neighbouring worker through a
+* Transport (shared memory rings, or local sockets). After each step every worker
+* publishes its particles to shared memory, where the coordinator gathers them
+* for rendering.
+*
+* Workers are forked from the coordinator, so they start with a copy of all of its
+* state and can run the same simulation functions on their own slab of particles.
+*/
+class SlabDomain {
+public:
+	// simulation run by each worker for one step, on the worker's own particles
+	typedef void (*StepFunc)(int worker, const DomainInput &input);
+
+	// workers: number of slabs/processes. the box runs from minX to maxX along x.
+	// useSockets picks local sockets over shared memory rings for passing particles.
+	SlabDomain(int workers, float minX, float maxX, bool useSockets);
+	~SlabDomain();
+
+	// hands each particle in pool to the worker owning its slab and forks the workers.
+	// in each worker, pool is replaced with that worker's particles.
+	// returns false in the coordinator if the workers could not be started.
+	bool start(ParticlePool &pool, StepFunc step);
+
+	// runs one step on every worker and waits for them all to finish.
+	// returns false if a worker has died.
+	bool step(const DomainInput &input);
+
+	// replaces the contents of pool with every worker's particles as of the last step.
+	// particles which don't fit in a worker's region are left out, with a warning.
+	void gather(ParticlePool &pool);
+
+	// tells the workers to exit and waits for them
+	void stop();
+
+	// the slab (worker number) containing x
+	int slabOf(float x);
+
+	// lowest and highest x of a slab
+	float slabMin(int worker);
+	float slabMax(int worker);
+
+	int workerCount();
+
+	// particles which left their slab last step but are still waiting to be passed on,
+	// because the link to the neighbour was full
+	int queued();
+
+private:
+	// shared between the coordinator and all workers
+	class Control {
+	public:
+		// incremented by the coordinator to start a step, -1 tells workers to exit
+		std::atomic<int> step;
+		DomainInput input;
+		// last step each worker has sent its leaving particles for, and how many it had to
+		// hold back for the next step because a link was full
+		std::atomic<int> sent[MAX_WORKERS];
+		std::atomic<int> held[MAX_WORKERS];
+		// last step each worker finished, and how many particles it published
+		std::atomic<int> done[MAX_WORKERS];
+		std::atomic<int> published[MAX_WORKERS];
+		// particles each worker has which didn't fit in its region, so weren't published
+		std::atomic<int> unpublished[MAX_WORKERS];
+	};
+
+	int workers;
+	float minX;
+	float maxX;
+	bool useSockets;
+
+	// shared memory holding control, the rings, and each worker's published particles
+	void *memory;
+	size_t memorySize;
+	Control *control;
+	unsigned char *rings;
+	Particle3D *regions;
+	// particles each worker can publish
+	int regionCapacity;
+	// particles gather() last found left out of the regions
+	int hiddenReported;
+
+	// socket pairs between workers i and i + 1 (when using sockets)
+	std::vector<int> sockets;
+
+	std::vector<pid_t> pids;
+	int stepCount;
+
+	// ring carrying particles from worker `from` to its neighbour in direction dir (0 = left, 1 = right)
+	Ring* ring(int from, int dir);
+
+	// main loop of a worker process, never returns
+	void runWorker(int worker, ParticlePool &pool, StepFunc step);
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "mathLib3D.h"
+#include "particle3d.h"
+#include "particlepool.h"
+#include "emitter.h"
+#include <cstdlib>
+
+// random float between 0 and 1
+static float randFloat() {
+	return static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+}
+
+// random float between min and max
+static float randRange(float min, float max) {
+	return min + (randFloat() * (max - min));
+}
+
+Emitter::Emitter(Point3D position) {
+	this->position = position;
+	this->shape = EMIT_SPHERE;
+	this->extent = 0.2;
+
+	this->rate = 600;
+
+	// fire upwards in a fairly wide fountain
+	this->direction = Vec3D(0.0, 1.0, 0.0);
+	this->spread = 0.5;
+
+	this->minVelocity = 0.05;
+	this->maxVelocity = 0.15;
+
+	// live for 1-3 seconds at the default tick rate
+	this->minLifetime = 60;
+	this->maxLifetime = 180;
+
+	// start out yellow and fade to a dark red
+	this->startColor[0] = 1.0;
+	this->startColor[1] = 0.9;
+	this->startColor[2] = 0.2;
+	this->endColor[0] = 0.4;
+	this->endColor[1] = 0.0;
+	this->endColor[2] = 0.0;
+	this->startSize = 12;
+	this->endSize = 2;
+
+	this->active = true;
+	this->accumulator = 0;
+}
+
+int Emitter::emit(ParticlePool &pool, int id, float dt) {
+	if (!this->active) return 0;
+
+	// work out how many particles are due, keeping the fractional part for next time
+	this->accumulator += this->rate * dt;
+	int count = (int)this->accumulator;
+	this->accumulator -= count;
+
+	for (int i = 0; i < count; i++) {
+		Particle3D* p = pool.spawn();
+
+		// offset from the centre based on the shape
+		float oX = 0, oY = 0, oZ = 0;
+		if (this->shape == EMIT_BOX) {
+			oX = randRange(-this->extent, this->extent);
+			oY = randRange(-this->extent, this->extent);
+			oZ = randRange(-this->extent, this->extent);
+		} else if (this->shape == EMIT_SPHERE) {
+			// rejection sample a point inside the unit sphere
+			do {
+				oX = randRange(-1, 1);
+				oY = randRange(-1, 1);
+				oZ = randRange(-1, 1);
+			} while ((oX*oX) + (oY*oY) + (oZ*oZ) > 1);
+			oX *= this->extent;
+			oY *= this->extent;
+			oZ *= this->extent;
+		}
+		p->position = Point3D(this->position.mX + oX, this->position.mY + oY, this->position.mZ + oZ);
+
+		// blend the main direction with a random one based on the spread
+		Vec3D r = Vec3D(randRange(-1, 1), randRange(-1, 1), randRange(-1, 1));
+		Vec3D d = Vec3D(
+			(this->direction.mX * (1 - this->spread)) + (r.mX * this->spread),
+			(this->direction.mY * (1 - this->spread)) + (r.mY * this->spread),
+			(this->direction.mZ * (1 - this->spread)) + (r.mZ * this->spread));
+		// (avoid normalizing a zero vector)
+		p->direction = d.length() > 0.0001 ? d.normalize() : this->direction.normalize();
+		p->velocity = randRange(this->minVelocity, this->maxVelocity);
+
+		p->color[0] = this->startColor[0];
+		p->color[1] = this->startColor[1];
+		p->color[2] = this->startColor[2];
+		p->size = this->startSize;
+
+		// mouse interaction properties are the same as any new particle
+		p->range = randRange(1.0, 5.0);
+		p->speed = 0.01;
+		p->friction = 0.0005;
+		p->halo = false;
+
+		p->age = 0;
+		p->lifetime = randRange(this->minLifetime, this->maxLifetime);
+		p->emitter = id;
+	}
+
+	return count;
+}
+
+void Emitter::fade(Particle3D *p) {
+	// fraction of its life the particle has lived
+	float t = p->age / p->lifetime;
+	if (t > 1) t = 1;
+
+	for (int c = 0; c < 3; c++) {
+		p->color[c] = this->startColor[c] + ((this->endColor[c] - this->startColor[c]) * t);
+	}
+	p->size = this->startSize + ((this->endSize - this->startSize) * t);
+	if (p->size < 1) p->size = 1;
+}
@@ -0,0 +1,62 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include "mathLib3D.h"
+#include "particle3d.h"
+#include "particlepool.h"
+
+// shapes particles can be spawned within
+enum EmitterShape { EMIT_POINT, EMIT_SPHERE, EMIT_BOX };
+
+/**
+* Continuously spawns particles with a limited lifetime into a particle pool.
+*/
+class Emitter {
+public:
+	// construct an emitter at the given position with some default settings
+	Emitter(Point3D position);
+
+	// centre of the emitter
+	Point3D position;
+	// shape particles spawn in, and its radius (sphere) or half width (box)
+	EmitterShape shape;
+	float extent;
+
+	// particles spawned per second
+	float rate;
+
+	// main direction particles are fired in, and how far they may stray from it
+	// (0 = exactly along direction, 1 = any direction)
+	Vec3D direction;
+	float spread;
+
+	// range of starting velocities
+	float minVelocity;
+	float maxVelocity;
+
+	// range of lifetimes, in ticks
+	float minLifetime;
+	float maxLifetime;
+
+	// colour and size at birth and at death, particles fade between them as they age
+	float startColor[3];
+	float endColor[3];
+	float startSize;
+	float endSize;
+
+	// whether the emitter is currently spawning
+	bool active;
+
+	// spawns however many particles are due after dt seconds into the pool,
+	// tagging them with this emitter's id. returns the number spawned.
+	int emit(ParticlePool &pool, int id, float dt);
+
+	// updates colour/size of a particle from this emitter based on its age
+	void fade(Particle3D *p);
+
+private:
+	// fractional particles carried over between calls to emit
+	float accumulator;
+};
+
+#endif
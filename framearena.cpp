@@ -0,0 +1,64 @@
+#include "framearena.h"
+#include "allocstats.h"
+#include <stdint.h>
+
+// starting size of each thread's arena
+const size_t THREAD_ARENA_SIZE = 1 << 20;
+
+FrameArena::FrameArena(size_t size) {
+	this->size = size;
+	this->block = new char[size];
+	this->offset = 0;
+	this->overflowBytes = 0;
+	this->overflow.reserve(16);
+}
+
+FrameArena::~FrameArena() {
+	reset();
+	delete[] this->block;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t align) {
+	// round the offset up to the alignment
+	uintptr_t start = ((uintptr_t)this->block + this->offset + (align - 1)) & ~(uintptr_t)(align - 1);
+	size_t end = (start - (uintptr_t)this->block) + bytes;
+	if (end <= this->size) {
+		this->offset = end;
+		return (void*)start;
+	}
+
+	// out of room, fall back to the heap for now (new is aligned enough for anything we store).
+	// this goes through operator new so ALLOC_CHECK builds count it.
+	if (this->overflow.empty()) countGrowth();
+	char *p = new char[bytes];
+	this->overflow.push_back(p);
+	this->overflowBytes += bytes;
+	return p;
+}
+
+void FrameArena::reset() {
+	if (!this->overflow.empty()) {
+		for (int i = 0; i < this->overflow.size(); i++) delete[] this->overflow[i];
+		this->overflow.clear();
+
+		// make the block big enough for everything this frame needed, with room to spare
+		this->size = (this->size + this->overflowBytes) * 2;
+		delete[] this->block;
+		this->block = new char[this->size];
+		this->overflowBytes = 0;
+	}
+	this->offset = 0;
+}
+
+size_t FrameArena::used() {
+	return this->offset + this->overflowBytes;
+}
+
+size_t FrameArena::capacity() {
+	return this->size;
+}
+
+FrameArena& threadArena() {
+	static thread_local FrameArena arena(THREAD_ARENA_SIZE);
+	return arena;
+}
@@ -0,0 +1,72 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+/**
+* Bump allocator for scratch memory which only lives for one frame. Allocating just
+* moves an offset along one block; everything is freed at once by reset().
+* If a frame needs more than the block holds, the extra comes from the heap and the
+* block is enlarged on the next reset, so after a few frames the arena stops
+* touching the heap altogether.
+*/
+class FrameArena {
+public:
+	FrameArena(size_t size);
+	~FrameArena();
+
+	// returns bytes of memory aligned to align (a power of 2)
+	void* allocate(size_t bytes, size_t align);
+
+	// frees everything allocated since the last reset
+	void reset();
+
+	// bytes handed out since the last reset, and the size of the block
+	size_t used();
+	size_t capacity();
+
+private:
+	char *block;
+	size_t size;
+	size_t offset;
+
+	// heap allocations made once the block ran out, freed at reset
+	std::vector<char*> overflow;
+	size_t overflowBytes;
+
+	// can't be copied
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+};
+
+// the calling thread's own arena. the main thread's is reset after each tick and each
+// display, worker pool threads reset theirs after each task.
+FrameArena& threadArena();
+
+/**
+* Lets standard containers take their memory from a FrameArena, e.g.
+*   std::vector<float, ArenaAllocator<float> > v(n, ArenaAllocator<float>(threadArena()));
+* Deallocation does nothing, the memory comes back when the arena is reset, so
+* containers using this must not outlive the frame.
+*/
+template <class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+	template <class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(this->arena->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) {}
+
+	template <class U> bool operator==(const ArenaAllocator<U> &other) const { return this->arena == other.arena; }
+	template <class U> bool operator!=(const ArenaAllocator<U> &other) const { return this->arena != other.arena; }
+
+	FrameArena *arena;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "mathLib3D.h"
+#include "particle3d.h"
+#include "particlepool.h"
+#include "obstacles.h"
+#include "kernels.h"
+#include <math.h>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+* Motion for one combination of settings. see computeParticleMotion() in sim.cpp for how this works.
+*/
+template <ForceMode force, bool halos, FrictionModel friction>
+static void motionKernel(Particle3D *particles, int count, Point3D cp) {
+	for (int i = 0; i < count; i++) {
+		Particle3D *p = &particles[i];
+
+		if (force != FORCE_NONE) {
+			// vector from the particle to the camera point
+			float dX = cp.mX - p->position.mX;
+			float dY = cp.mY - p->position.mY;
+			float dZ = cp.mZ - p->position.mZ;
+			float dist2 = (dX * dX) + (dY * dY) + (dZ * dZ);
+
+			// compare squared distances so the square root is only needed for particles in range
+			bool inRange = dist2 <= p->range * p->range;
+			if (inRange) {
+				// towards the camera to attract, away from it to repel
+				if (dist2 > 0) {
+					float scale = (force == FORCE_ATTRACT ? 1.0 : -1.0) / sqrt(dist2);
+					p->direction = Vec3D(dX * scale, dY * scale, dZ * scale);
+				}
+				p->velocity += p->speed;
+			}
+			if (halos) p->halo = inRange;
+		} else if (halos) {
+			p->halo = false;
+		}
+
+		if (friction == FRICTION_LINEAR) {
+			// decrease the velocity of the particle based on friction, to a minimum of 0
+			p->velocity -= ((float)(p->size) * p->friction);
+			if (p->velocity < 0) p->velocity = 0;
+		}
+	}
+}
+
+/**
+* Moves a particle by `move` inside the box from lo to hi. The walls are axis aligned planes, so
+* mirroring the end of the move back across any plane it crossed lands exactly where a continuous
+* bounce would have, however fast the particle is going. Each axis is independent, so with SSE all
+* three are done at once with no branches.
+*/
+static inline void moveInBox(Particle3D *p, Vec3D move, const float lo[4], const float hi[4]) {
+#ifdef __SSE2__
+	__m128 vlo = _mm_loadu_ps(lo);
+	__m128 vhi = _mm_loadu_ps(hi);
+	__m128 zero = _mm_setzero_ps();
+	__m128 next = _mm_add_ps(_mm_set_ps(0, p->position.mZ, p->position.mY, p->position.mX),
+		_mm_set_ps(0, move.mZ, move.mY, move.mX));
+
+	// how far past each wall the move went
+	__m128 over = _mm_max_ps(_mm_sub_ps(next, vhi), zero);
+	__m128 under = _mm_max_ps(_mm_sub_ps(vlo, next), zero);
+	__m128 hit = _mm_cmpgt_ps(_mm_add_ps(over, under), zero);
+
+	// reflect back inside, and clamp in case it crossed the whole box in one tick
+	next = _mm_add_ps(next, _mm_mul_ps(_mm_sub_ps(under, over), _mm_set1_ps(2)));
+	next = _mm_min_ps(_mm_max_ps(next, vlo), vhi);
+
+	// flip the sign of the direction on every axis that bounced
+	__m128 dir = _mm_set_ps(0, p->direction.mZ, p->direction.mY, p->direction.mX);
+	dir = _mm_xor_ps(dir, _mm_and_ps(hit, _mm_set1_ps(-0.0f)));
+
+	float out[4];
+	_mm_storeu_ps(out, next);
+	p->position = Point3D(out[0], out[1], out[2]);
+	_mm_storeu_ps(out, dir);
+	p->direction = Vec3D(out[0], out[1], out[2]);
+#else
+	float pos[3] = {p->position.mX + move.mX, p->position.mY + move.mY, p->position.mZ + move.mZ};
+	float dir[3] = {p->direction.mX, p->direction.mY, p->direction.mZ};
+	for (int i = 0; i < 3; i++) {
+		if (pos[i] > hi[i]) {
+			pos[i] = (2 * hi[i]) - pos[i];
+			dir[i] = -dir[i];
+		} else if (pos[i] < lo[i]) {
+			pos[i] = (2 * lo[i]) - pos[i];
+			dir[i] = -dir[i];
+		}
+		pos[i] = std::min(std::max(pos[i], lo[i]), hi[i]);
+	}
+	p->position = Point3D(pos[0], pos[1], pos[2]);
+	p->direction = Vec3D(dir[0], dir[1], dir[2]);
+#endif
+}
+
+// reflects v about the plane with normal n
+static inline Vec3D reflect(Vec3D v, Vec3D n) {
+	float d = 2 * ((v.mX * n.mX) + (v.mY * n.mY) + (v.mZ * n.mZ));
+	return Vec3D(v.mX - (n.mX * d), v.mY - (n.mY * d), v.mZ - (n.mZ * d));
+}
+
+// how far a particle is left off a surface after bouncing, so it doesn't start the next sweep touching it
+const float BOUNCE_GAP = 0.001;
+
+// most bounces followed in one tick. anything left of the move after that is dropped.
+const int MAX_BOUNCES = 4;
+
+/**
+* Earliest point along move where a particle at pos leaves the box from lo to hi, as a fraction t
+* of move, with the normal of the wall it hits.
+*/
+static inline bool sweepBox(Point3D pos, Vec3D move, const float lo[4], const float hi[4], float &t, Vec3D &normal) {
+	float s[3] = {pos.mX, pos.mY, pos.mZ};
+	float d[3] = {move.mX, move.mY, move.mZ};
+	int axis = -1;
+	float side = 0;
+	for (int i = 0; i < 3; i++) {
+		float ht;
+		if (d[i] > 0 && s[i] + d[i] > hi[i]) ht = (hi[i] - s[i]) / d[i];
+		else if (d[i] < 0 && s[i] + d[i] < lo[i]) ht = (lo[i] - s[i]) / d[i];
+		else continue;
+		if (axis < 0 || ht < t) {
+			t = ht < 0 ? 0 : ht;
+			axis = i;
+			side = d[i] > 0 ? -1 : 1;
+		}
+	}
+	if (axis < 0) return false;
+	normal = Vec3D(axis == 0 ? side : 0, axis == 1 ? side : 0, axis == 2 ? side : 0);
+	return true;
+}
+
+/**
+* Moves a particle by `move`, following it through every bounce off the walls (if walls is on) and
+* obstacles along the way: find the earliest surface hit, move to it, reflect the rest of the move
+* and the direction about the surface normal, and carry on from there.
+*/
+template <bool walls>
+static inline void moveWithObstacles(Particle3D *p, Vec3D move, const float lo[4], const float hi[4], ObstacleBVH *bvh) {
+	for (int bounce = 0; bounce <= MAX_BOUNCES; bounce++) {
+		float t = 2;
+		Vec3D n;
+		float ht;
+		Vec3D hn;
+		if (bvh->sweep(p->position, move, ht, hn)) {
+			t = ht;
+			n = hn;
+		}
+		if (walls && sweepBox(p->position, move, lo, hi, ht, hn) && ht < t) {
+			t = ht;
+			n = hn;
+		}
+
+		if (t > 1) {
+			// nothing in the way
+			p->position.mX += move.mX;
+			p->position.mY += move.mY;
+			p->position.mZ += move.mZ;
+			return;
+		}
+
+		p->position = Point3D(p->position.mX + (move.mX * t) + (n.mX * BOUNCE_GAP),
+			p->position.mY + (move.mY * t) + (n.mY * BOUNCE_GAP),
+			p->position.mZ + (move.mZ * t) + (n.mZ * BOUNCE_GAP));
+		p->direction = reflect(p->direction, n);
+		// out of bounces, stop at the surface
+		if (bounce == MAX_BOUNCES) return;
+		move = reflect(move.multiply(1 - t), n);
+	}
+}
+
+/**
+* Movement for one combination of settings. see moveParticles() in sim.cpp.
+*/
+template <bool walls, bool obstacles>
+static void moveKernel(Particle3D *particles, int count, float wall, float depth, ObstacleBVH *bvh) {
+	const float lo[4] = {-wall, -wall, 0.1, 0};
+	const float hi[4] = {wall, wall, depth, 0};
+
+	for (int i = 0; i < count; i++) {
+		Particle3D *p = &particles[i];
+		float mX = p->direction.mX * p->velocity;
+		float mY = p->direction.mY * p->velocity;
+		float mZ = p->direction.mZ * p->velocity;
+
+		if (obstacles) {
+			if (p->velocity > 0) moveWithObstacles<walls>(p, Vec3D(mX, mY, mZ), lo, hi, bvh);
+			continue;
+		}
+
+		float nX = p->position.mX + mX;
+		float nY = p->position.mY + mY;
+		float nZ = p->position.mZ + mZ;
+		// most moves stay inside the box, only the ones crossing a wall need reflecting
+		if (walls && (nX < lo[0] || nX > hi[0] || nY < lo[1] || nY > hi[1] || nZ < lo[2] || nZ > hi[2])) {
+			moveInBox(p, Vec3D(mX, mY, mZ), lo, hi);
+		} else {
+			p->position.mX = nX;
+			p->position.mY = nY;
+			p->position.mZ = nZ;
+		}
+	}
+}
+
+typedef void (*MotionKernel)(Particle3D*, int, Point3D);
+typedef void (*MoveKernel)(Particle3D*, int, float, float, ObstacleBVH*);
+
+// every specialization, indexed by [force][halos][friction]
+static const MotionKernel MOTION_KERNELS[3][2][2] = {
+	{
+		{motionKernel<FORCE_NONE, false, FRICTION_LINEAR>, motionKernel<FORCE_NONE, false, FRICTION_NONE>},
+		{motionKernel<FORCE_NONE, true, FRICTION_LINEAR>, motionKernel<FORCE_NONE, true, FRICTION_NONE>}
+	},
+	{
+		{motionKernel<FORCE_ATTRACT, false, FRICTION_LINEAR>, motionKernel<FORCE_ATTRACT, false, FRICTION_NONE>},
+		{motionKernel<FORCE_ATTRACT, true, FRICTION_LINEAR>, motionKernel<FORCE_ATTRACT, true, FRICTION_NONE>}
+	},
+	{
+		{motionKernel<FORCE_REPEL, false, FRICTION_LINEAR>, motionKernel<FORCE_REPEL, false, FRICTION_NONE>},
+		{motionKernel<FORCE_REPEL, true, FRICTION_LINEAR>, motionKernel<FORCE_REPEL, true, FRICTION_NONE>}
+	}
+};
+
+// indexed by [walls][obstacles]
+static const MoveKernel MOVE_KERNELS[2][2] = {
+	{moveKernel<false, false>, moveKernel<false, true>},
+	{moveKernel<true, false>, moveKernel<true, true>}
+};
+
+void runMotionKernel(ForceMode force, bool halos, FrictionModel friction, ParticlePool &pool, Point3D cp) {
+	if (pool.size() == 0) return;
+	MOTION_KERNELS[force][halos ? 1 : 0][friction](&pool[0], pool.size(), cp);
+}
+
+void runMoveKernel(bool walls, ParticlePool &pool, float wall, float depth, ObstacleBVH &obstacles) {
+	if (pool.size() == 0) return;
+	MOVE_KERNELS[walls ? 1 : 0][obstacles.size() > 0 ? 1 : 0](&pool[0], pool.size(), wall, depth, &obstacles);
+}
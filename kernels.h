@@ -0,0 +1,28 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "mathLib3D.h"
+#include "particlepool.h"
+#include "obstacles.h"
+
+// what the mouse is doing to particles in range of the camera
+enum ForceMode { FORCE_NONE, FORCE_ATTRACT, FORCE_REPEL };
+
+// how particles slow down: by size * friction each tick, or not at all
+enum FrictionModel { FRICTION_LINEAR, FRICTION_NONE };
+
+/**
+* The per particle update loops are templates specialized on every combination of
+* these settings, so each loop has no mode checks inside it. These functions pick
+* the right specialization once and run it over the whole pool.
+*/
+
+// updates direction/velocity/halo of every particle given the point the camera is looking at
+void runMotionKernel(ForceMode force, bool halos, FrictionModel friction, ParticlePool &pool, Point3D cp);
+
+// moves every particle, bouncing off the walls (if walls is on) which are `wall` from the
+// centre on x/y and run from 0.1 to `depth` on z, and off any obstacles. collisions are
+// found along the whole move, so fast particles can't skip through a wall or obstacle.
+void runMoveKernel(bool walls, ParticlePool &pool, float wall, float depth, ObstacleBVH &obstacles);
+
+#endif
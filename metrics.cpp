@@ -0,0 +1,303 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+
+// not every platform can turn off SIGPIPE per send (OS X uses SO_NOSIGPIPE instead)
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// upper bounds of the histogram buckets, in seconds
+static const double BUCKET_BOUNDS[Metrics::BUCKETS] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+
+// how long a scrape waits for the frame loop to sample the gauges before using the last values
+const int SAMPLE_WAIT_MS = 100;
+
+// how often the server checks whether it has been stopped
+const int POLL_MS = 200;
+
+Metrics::Metrics() {
+	this->histogramCount = 0;
+	this->counterCount = 0;
+	this->gaugeCount = 0;
+	for (int i = 0; i < MAX_METRICS; i++) this->gaugeValues[i].store(0);
+	for (int t = 0; t < MAX_THREADS; t++) {
+		for (int i = 0; i < MAX_METRICS; i++) {
+			for (int b = 0; b <= BUCKETS; b++) this->slots[t].buckets[i][b].store(0);
+			this->slots[t].sums[i].store(0);
+			this->slots[t].counters[i].store(0);
+		}
+	}
+	this->slotsUsed.store(0);
+	this->requested.store(0);
+	this->answered.store(0);
+	this->listenFd = -1;
+	this->path[0] = '\0';
+	this->serving.store(false);
+}
+
+Metrics::~Metrics() {
+	stop();
+}
+
+Metrics& Metrics::shared() {
+	static Metrics metrics;
+	return metrics;
+}
+
+int Metrics::addHistogram(const char *name, const char *help, const char *stage) {
+	if (this->histogramCount == MAX_METRICS) return -1;
+	Info info = {name, help, stage};
+	this->histograms[this->histogramCount] = info;
+	return this->histogramCount++;
+}
+
+int Metrics::addCounter(const char *name, const char *help) {
+	if (this->counterCount == MAX_METRICS) return -1;
+	Info info = {name, help, NULL};
+	this->counters[this->counterCount] = info;
+	return this->counterCount++;
+}
+
+int Metrics::addGauge(const char *name, const char *help) {
+	if (this->gaugeCount == MAX_METRICS) return -1;
+	Info info = {name, help, NULL};
+	this->gauges[this->gaugeCount] = info;
+	return this->gaugeCount++;
+}
+
+Metrics::Slot& Metrics::slot() {
+	// each thread takes the next free slot the first time it records anything.
+	// if there are more threads than slots the extras share the last one, which is still
+	// correct (the values are atomic) just not contention free.
+	static thread_local int index = -1;
+	if (index < 0) {
+		index = this->slotsUsed.fetch_add(1, std::memory_order_relaxed);
+		if (index >= MAX_THREADS) index = MAX_THREADS - 1;
+	}
+	return this->slots[index];
+}
+
+void Metrics::observe(int histogram, double ms) {
+	if (histogram < 0) return;
+	double seconds = ms / 1000;
+	int b = 0;
+	while (b < BUCKETS && seconds > BUCKET_BOUNDS[b]) b++;
+	Slot &s = slot();
+	// buckets are stored un-cumulated, and added up when formatted
+	s.buckets[histogram][b].fetch_add(1, std::memory_order_relaxed);
+	s.sums[histogram].fetch_add((uint64_t)(ms * 1000000), std::memory_order_relaxed);
+}
+
+void Metrics::count(int counter, long n) {
+	if (counter < 0) return;
+	slot().counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Metrics::setGauge(int gauge, long value) {
+	if (gauge < 0) return;
+	this->gaugeValues[gauge].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::sampled() {
+	// gauges written before this are visible to the scrape that sees it
+	this->answered.store(this->requested.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+bool Metrics::start(const char *address) {
+	if (running()) return true;
+
+	bool tcp = address[0] != '\0' && strspn(address, "0123456789") == strlen(address);
+	if (tcp) {
+		this->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		if (this->listenFd >= 0) {
+			int on = 1;
+			setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			struct sockaddr_in addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons(atoi(address));
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (bind(this->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+				close(this->listenFd);
+				this->listenFd = -1;
+			}
+		}
+	} else {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (strlen(address) >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "metrics: socket path '%s' is too long\n", address);
+			return false;
+		}
+		strcpy(addr.sun_path, address);
+		this->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (this->listenFd >= 0) {
+			// clear out a socket left behind by an earlier run
+			unlink(address);
+			if (bind(this->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+				close(this->listenFd);
+				this->listenFd = -1;
+			} else {
+				strcpy(this->path, address);
+			}
+		}
+	}
+
+	if (this->listenFd < 0 || listen(this->listenFd, 4) != 0) {
+		perror("metrics: could not listen");
+		if (this->listenFd >= 0) close(this->listenFd);
+		this->listenFd = -1;
+		return false;
+	}
+
+	this->serving.store(true);
+	this->server = std::thread(&Metrics::serve, this);
+	return true;
+}
+
+void Metrics::stop() {
+	if (!running()) return;
+	this->serving.store(false);
+	this->server.join();
+	close(this->listenFd);
+	this->listenFd = -1;
+	if (this->path[0] != '\0') unlink(this->path);
+	this->path[0] = '\0';
+}
+
+void Metrics::serve() {
+	while (running()) {
+		// wait for a connection, waking up now and then to see if we've been stopped
+		struct pollfd pfd;
+		pfd.fd = this->listenFd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, POLL_MS) <= 0) continue;
+
+		int fd = accept(this->listenFd, NULL, NULL);
+		if (fd < 0) continue;
+		answer(fd);
+		close(fd);
+	}
+}
+
+void Metrics::answer(int fd) {
+	// read the request (we answer anything the same way). a client that never sends
+	// one only holds the server up for a second.
+	struct timeval timeout;
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+	char request[2048];
+	int got = 0;
+	while (got < (int)sizeof(request) - 1) {
+		ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+		if (n <= 0) break;
+		got += n;
+		request[got] = '\0';
+		if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) break;
+	}
+
+	// ask the frame loop to sample the gauges, and give it a moment to do so
+	unsigned int want = this->requested.fetch_add(1, std::memory_order_relaxed) + 1;
+	std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(SAMPLE_WAIT_MS);
+	while ((int)(this->answered.load(std::memory_order_acquire) - want) < 0 && std::chrono::steady_clock::now() < until) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// formatted into fixed buffers so scrapes never touch the heap
+	static char body[65536];
+	static char header[256];
+	int length = format(body, sizeof(body));
+	int headerLength = snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", length);
+
+	const char *parts[2] = {header, body};
+	int lengths[2] = {headerLength, length};
+	for (int p = 0; p < 2; p++) {
+		int sent = 0;
+		while (sent < lengths[p]) {
+			ssize_t n = send(fd, parts[p] + sent, lengths[p] - sent, MSG_NOSIGNAL);
+			if (n <= 0) return;
+			sent += n;
+		}
+	}
+}
+
+/**
+* printf onto the end of out, stopping quietly once it fills up.
+*/
+static void append(char *out, int size, int &len, const char *fmt, ...) {
+	if (len >= size) return;
+	va_list args;
+	va_start(args, fmt);
+	len += vsnprintf(out + len, size - len, fmt, args);
+	va_end(args);
+}
+
+int Metrics::format(char *out, int size) {
+	int len = 0;
+
+	for (int i = 0; i < this->histogramCount; i++) {
+		Info &info = this->histograms[i];
+		if (i == 0 || strcmp(info.name, this->histograms[i - 1].name) != 0) {
+			append(out, size, len, "# HELP %s %s\n# TYPE %s histogram\n", info.name, info.help, info.name);
+		}
+
+		uint64_t buckets[BUCKETS + 1] = {0};
+		uint64_t sum = 0;
+		for (int t = 0; t < MAX_THREADS; t++) {
+			for (int b = 0; b <= BUCKETS; b++) buckets[b] += this->slots[t].buckets[i][b].load(std::memory_order_relaxed);
+			sum += this->slots[t].sums[i].load(std::memory_order_relaxed);
+		}
+
+		// labels inside the braces, with a trailing comma when there are any
+		char labels[128];
+		if (info.stage != NULL) snprintf(labels, sizeof(labels), "stage=\"%s\",", info.stage);
+		else labels[0] = '\0';
+
+		uint64_t total = 0;
+		for (int b = 0; b <= BUCKETS; b++) {
+			total += buckets[b];
+			if (b < BUCKETS) append(out, size, len, "%s_bucket{%sle=\"%g\"} %llu\n", info.name, labels, BUCKET_BOUNDS[b], (unsigned long long)total);
+			else append(out, size, len, "%s_bucket{%sle=\"+Inf\"} %llu\n", info.name, labels, (unsigned long long)total);
+		}
+		// drop the trailing comma for the sum and count
+		int labelLength = strlen(labels);
+		if (labelLength > 0) labels[labelLength - 1] = '\0';
+		const char *openBrace = labelLength > 0 ? "{" : "";
+		const char *closeBrace = labelLength > 0 ? "}" : "";
+		append(out, size, len, "%s_sum%s%s%s %.9f\n", info.name, openBrace, labels, closeBrace, sum / 1e9);
+		append(out, size, len, "%s_count%s%s%s %llu\n", info.name, openBrace, labels, closeBrace, (unsigned long long)total);
+	}
+
+	for (int i = 0; i < this->counterCount; i++) {
+		uint64_t total = 0;
+		for (int t = 0; t < MAX_THREADS; t++) total += this->slots[t].counters[i].load(std::memory_order_relaxed);
+		append(out, size, len, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", this->counters[i].name, this->counters[i].help,
+			this->counters[i].name, this->counters[i].name, (unsigned long long)total);
+	}
+
+	for (int i = 0; i < this->gaugeCount; i++) {
+		append(out, size, len, "# HELP %s %s\n# TYPE %s gauge\n%s %ld\n", this->gauges[i].name, this->gauges[i].help,
+			this->gauges[i].name, this->gauges[i].name, this->gaugeValues[i].load(std::memory_order_relaxed));
+	}
+
+	return len < size ? len : size - 1;
+}
@@ -0,0 +1,113 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+/**
+* Optional exporter serving runtime metrics in the Prometheus text format, on a loopback
+* TCP port or a Unix domain socket, from a background thread.
+*
+* Every thread which records a metric gets its own slot of counters, so recording is a
+* relaxed atomic add with no locks and no sharing between threads. A scrape sums the
+* slots. Gauges which cost something to work out (like counting active particles) are
+* only filled in when a scrape asks for them, see wantsSample().
+*
+* Metrics are registered up front, before start(), and recorded by the id they are given.
+*/
+class Metrics {
+public:
+	// most metrics of each kind, and most threads with their own slot
+	static const int MAX_METRICS = 24;
+	static const int MAX_THREADS = 16;
+	// histogram bucket upper bounds are in seconds, with one more bucket for +Inf
+	static const int BUCKETS = 10;
+
+	Metrics();
+	~Metrics();
+
+	// registers a histogram of durations. metrics with the same name are one family,
+	// told apart by their stage label (which may be NULL).
+	int addHistogram(const char *name, const char *help, const char *stage);
+	// registers a counter, which only ever goes up
+	int addCounter(const char *name, const char *help);
+	// registers a gauge, which is set to whatever the current value is
+	int addGauge(const char *name, const char *help);
+
+	// starts serving. address is a port number to listen on 127.0.0.1, or else
+	// the path of a Unix domain socket. returns false (and prints why) on failure.
+	bool start(const char *address);
+	// stops serving and removes the socket file
+	void stop();
+
+	// whether the exporter is serving. nothing needs recording when it isn't.
+	bool running() { return this->serving.load(std::memory_order_relaxed); }
+
+	// records a duration in milliseconds in a histogram, from any thread
+	void observe(int histogram, double ms);
+	// adds to a counter, from any thread
+	void count(int counter, long n);
+	// sets a gauge
+	void setGauge(int gauge, long value);
+
+	// whether a scrape is waiting for the gauges to be sampled. the frame loop checks this
+	// once per tick and, if set, sets every gauge then calls sampled().
+	bool wantsSample() {
+		return this->requested.load(std::memory_order_relaxed) != this->answered.load(std::memory_order_relaxed);
+	}
+	void sampled();
+
+	// exporter shared by the whole program
+	static Metrics& shared();
+
+private:
+	class Info {
+	public:
+		const char *name;
+		const char *help;
+		const char *stage;
+	};
+
+	// one thread's values, kept on their own cache lines
+	class alignas(64) Slot {
+	public:
+		std::atomic<uint64_t> buckets[MAX_METRICS][BUCKETS + 1];
+		// histogram sums in nanoseconds
+		std::atomic<uint64_t> sums[MAX_METRICS];
+		std::atomic<uint64_t> counters[MAX_METRICS];
+	};
+
+	Info histograms[MAX_METRICS];
+	Info counters[MAX_METRICS];
+	Info gauges[MAX_METRICS];
+	int histogramCount;
+	int counterCount;
+	int gaugeCount;
+	std::atomic<long> gaugeValues[MAX_METRICS];
+
+	Slot slots[MAX_THREADS];
+	// slots handed out so far
+	std::atomic<int> slotsUsed;
+
+	// scrapes asking for a sample, and samples taken
+	std::atomic<unsigned int> requested;
+	std::atomic<unsigned int> answered;
+
+	int listenFd;
+	// socket file to remove on stop (empty for TCP)
+	char path[108];
+	std::atomic<bool> serving;
+	std::thread server;
+
+	// the calling thread's slot
+	Slot& slot();
+	// accepts and answers scrapes until stopped
+	void serve();
+	// answers one scrape on a connected socket
+	void answer(int fd);
+	// writes every metric into out, returning the length
+	int format(char *out, int size);
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "mathLib3D.h"
+#include "obstacles.h"
+#include <math.h>
+#include <algorithm>
+
+// most obstacles kept in one leaf of the tree
+const int LEAF_SIZE = 2;
+
+Obstacle Obstacle::sphere(Point3D center, float radius) {
+	Obstacle o;
+	o.shape = OBSTACLE_SPHERE;
+	o.center = center;
+	o.radius = radius;
+	o.halfSize = Vec3D(radius, radius, radius);
+	return o;
+}
+
+Obstacle Obstacle::box(Point3D center, Vec3D halfSize) {
+	Obstacle o;
+	o.shape = OBSTACLE_BOX;
+	o.center = center;
+	o.radius = halfSize.length();
+	o.halfSize = halfSize;
+	return o;
+}
+
+Point3D Obstacle::boundsMin() {
+	return Point3D(this->center.mX - this->halfSize.mX, this->center.mY - this->halfSize.mY, this->center.mZ - this->halfSize.mZ);
+}
+
+Point3D Obstacle::boundsMax() {
+	return Point3D(this->center.mX + this->halfSize.mX, this->center.mY + this->halfSize.mY, this->center.mZ + this->halfSize.mZ);
+}
+
+bool Obstacle::sweep(Point3D start, Vec3D move, float &t, Vec3D &normal) {
+	if (this->shape == OBSTACLE_SPHERE) {
+		// solve |start + t * move - center| = radius for the smaller t
+		Vec3D m = Vec3D::createVector(this->center, start);
+		float a = (move.mX * move.mX) + (move.mY * move.mY) + (move.mZ * move.mZ);
+		float b = (m.mX * move.mX) + (m.mY * move.mY) + (m.mZ * move.mZ);
+		float c = (m.mX * m.mX) + (m.mY * m.mY) + (m.mZ * m.mZ) - (this->radius * this->radius);
+		// starting inside, or moving away
+		if (c <= 0 || b >= 0 || a == 0) return false;
+		float disc = (b * b) - (a * c);
+		if (disc < 0) return false;
+		float hit = (-b - sqrt(disc)) / a;
+		if (hit > 1) return false;
+
+		t = hit;
+		Point3D p = Point3D(start.mX + (move.mX * t), start.mY + (move.mY * t), start.mZ + (move.mZ * t));
+		normal = Vec3D::createVector(this->center, p).normalize();
+		return true;
+	}
+
+	// slab test: find where the segment is inside the box on every axis at once
+	float s[3] = {start.mX, start.mY, start.mZ};
+	float d[3] = {move.mX, move.mY, move.mZ};
+	float lo[3] = {this->center.mX - this->halfSize.mX, this->center.mY - this->halfSize.mY, this->center.mZ - this->halfSize.mZ};
+	float hi[3] = {this->center.mX + this->halfSize.mX, this->center.mY + this->halfSize.mY, this->center.mZ + this->halfSize.mZ};
+	float tEnter = 0, tExit = 1;
+	int axis = -1;
+	float side = 0;
+	for (int i = 0; i < 3; i++) {
+		if (d[i] == 0) {
+			if (s[i] < lo[i] || s[i] > hi[i]) return false;
+			continue;
+		}
+		float t0 = (lo[i] - s[i]) / d[i];
+		float t1 = (hi[i] - s[i]) / d[i];
+		// entering through the low face means the normal points down the axis
+		float faceSide = -1;
+		if (t0 > t1) {
+			std::swap(t0, t1);
+			faceSide = 1;
+		}
+		if (t0 > tEnter) {
+			tEnter = t0;
+			axis = i;
+			side = faceSide;
+		}
+		if (t1 < tExit) tExit = t1;
+		if (tEnter > tExit) return false;
+	}
+	// axis is only unset if the segment starts inside the box
+	if (axis < 0) return false;
+
+	t = tEnter;
+	normal = Vec3D(axis == 0 ? side : 0, axis == 1 ? side : 0, axis == 2 ? side : 0);
+	return true;
+}
+
+ObstacleBVH::ObstacleBVH() {}
+
+void ObstacleBVH::add(Obstacle obstacle) {
+	this->obstacles.push_back(obstacle);
+	rebuild();
+}
+
+void ObstacleBVH::clear() {
+	this->obstacles.clear();
+	this->nodes.clear();
+}
+
+int ObstacleBVH::size() {
+	return this->obstacles.size();
+}
+
+Obstacle& ObstacleBVH::operator[](int i) {
+	return this->obstacles[i];
+}
+
+void ObstacleBVH::rebuild() {
+	this->nodes.clear();
+	if (!this->obstacles.empty()) build(0, this->obstacles.size());
+}
+
+// orders obstacles by their centre on one axis
+class CenterOrder {
+public:
+	int axis;
+	bool operator()(const Obstacle &a, const Obstacle &b) const {
+		float ca = axis == 0 ? a.center.mX : (axis == 1 ? a.center.mY : a.center.mZ);
+		float cb = axis == 0 ? b.center.mX : (axis == 1 ? b.center.mY : b.center.mZ);
+		return ca < cb;
+	}
+};
+
+int ObstacleBVH::build(int first, int count) {
+	int index = this->nodes.size();
+	this->nodes.push_back(Node());
+
+	// bounds of everything under this node
+	Node node;
+	for (int i = 0; i < 3; i++) {
+		node.min[i] = INFINITY;
+		node.max[i] = -INFINITY;
+	}
+	for (int i = first; i < first + count; i++) {
+		Point3D lo = this->obstacles[i].boundsMin();
+		Point3D hi = this->obstacles[i].boundsMax();
+		node.min[0] = std::min(node.min[0], lo.mX);
+		node.min[1] = std::min(node.min[1], lo.mY);
+		node.min[2] = std::min(node.min[2], lo.mZ);
+		node.max[0] = std::max(node.max[0], hi.mX);
+		node.max[1] = std::max(node.max[1], hi.mY);
+		node.max[2] = std::max(node.max[2], hi.mZ);
+	}
+	node.first = first;
+	node.count = count;
+	node.left = -1;
+	node.right = -1;
+
+	if (count > LEAF_SIZE) {
+		// split at the median along the longest axis
+		CenterOrder order;
+		order.axis = 0;
+		for (int i = 1; i < 3; i++) {
+			if (node.max[i] - node.min[i] > node.max[order.axis] - node.min[order.axis]) order.axis = i;
+		}
+		int half = count / 2;
+		std::nth_element(this->obstacles.begin() + first, this->obstacles.begin() + first + half,
+			this->obstacles.begin() + first + count, order);
+		node.count = 0;
+		node.left = build(first, half);
+		node.right = build(first + half, count - half);
+	}
+
+	this->nodes[index] = node;
+	return index;
+}
+
+bool ObstacleBVH::sweep(Point3D start, Vec3D move, float &t, Vec3D &normal) {
+	if (this->nodes.empty()) return false;
+
+	// bounds of the segment
+	float s[3] = {start.mX, start.mY, start.mZ};
+	float e[3] = {start.mX + move.mX, start.mY + move.mY, start.mZ + move.mZ};
+	float segMin[3], segMax[3];
+	for (int i = 0; i < 3; i++) {
+		segMin[i] = std::min(s[i], e[i]);
+		segMax[i] = std::max(s[i], e[i]);
+	}
+
+	bool hit = false;
+	float best = 2;
+	// walk the tree with a small fixed stack
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		Node &node = this->nodes[stack[--top]];
+		bool overlaps = true;
+		for (int i = 0; i < 3; i++) {
+			if (segMax[i] < node.min[i] || segMin[i] > node.max[i]) overlaps = false;
+		}
+		if (!overlaps) continue;
+
+		if (node.left < 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				float ht;
+				Vec3D hn;
+				if (this->obstacles[i].sweep(start, move, ht, hn) && ht < best) {
+					best = ht;
+					t = ht;
+					normal = hn;
+					hit = true;
+				}
+			}
+		} else if (top + 2 <= 64) {
+			stack[top++] = node.left;
+			stack[top++] = node.right;
+		}
+	}
+	return hit;
+}
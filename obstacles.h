@@ -0,0 +1,77 @@
+#ifndef OBSTACLES_H
+#define OBSTACLES_H
+
+#include "mathLib3D.h"
+#include <vector>
+
+// shapes an obstacle can have
+enum ObstacleShape { OBSTACLE_SPHERE, OBSTACLE_BOX };
+
+/**
+* A solid, static obstacle particles bounce off.
+*/
+class Obstacle {
+public:
+	// a sphere with the given radius
+	static Obstacle sphere(Point3D center, float radius);
+	// an axis aligned box with the given half sizes
+	static Obstacle box(Point3D center, Vec3D halfSize);
+
+	ObstacleShape shape;
+	Point3D center;
+	// radius of a sphere
+	float radius;
+	// half width/height/depth of a box
+	Vec3D halfSize;
+
+	// earliest point along the segment from start to start + move where it enters the obstacle,
+	// as a fraction t of move, with the surface normal there. segments starting inside never hit.
+	bool sweep(Point3D start, Vec3D move, float &t, Vec3D &normal);
+
+	// corners of the box around the obstacle
+	Point3D boundsMin();
+	Point3D boundsMax();
+};
+
+/**
+* Bounding volume hierarchy over a set of obstacles, so a moving particle only has
+* to be tested against the obstacles whose bounds its path passes through.
+*/
+class ObstacleBVH {
+public:
+	ObstacleBVH();
+
+	// adds an obstacle and rebuilds the tree
+	void add(Obstacle obstacle);
+
+	// removes every obstacle
+	void clear();
+
+	int size();
+	Obstacle& operator[](int i);
+
+	// earliest hit of the segment from start to start + move against any obstacle (see Obstacle::sweep)
+	bool sweep(Point3D start, Vec3D move, float &t, Vec3D &normal);
+
+private:
+	class Node {
+	public:
+		float min[3];
+		float max[3];
+		// children for an inner node, or the first obstacle and obstacle count for a leaf
+		int left;
+		int right;
+		int first;
+		int count;
+	};
+
+	std::vector<Obstacle> obstacles;
+	std::vector<Node> nodes;
+
+	// builds the node covering obstacles [first, first + count), returning its index
+	int build(int first, int count);
+	// rebuilds the whole tree
+	void rebuild();
+};
+
+#endif
@@ -33,4 +33,9 @@ Particle3D::Particle3D() {
 	this->velocity = 0;
 
 	this->halo = false;
+
+	// particles live forever unless spawned by an emitter
+	this->age = 0;
+	this->lifetime = 0;
+	this->emitter = -1;
 }
\ No newline at end of file
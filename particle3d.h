@@ -17,6 +17,13 @@ public:
 	float friction;
 
 	bool halo;
+
+	// number of ticks the particle has been alive for, and how many it lives for
+	// (a lifetime of 0 means the particle lives forever)
+	float age;
+	float lifetime;
+	// index of the emitter which spawned the particle, or -1 if it wasn't emitted
+	int emitter;
 };
 
 #endif
\ No newline at end of file
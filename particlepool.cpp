@@ -0,0 +1,103 @@
+#include "particle3d.h"
+#include "particlepool.h"
+#include "allocstats.h"
+
+ParticlePool::ParticlePool(int capacity) {
+	this->count = 0;
+	grow(capacity);
+}
+
+void ParticlePool::grow(int capacity) {
+	int old = this->storage.size();
+	this->storage.resize(capacity);
+	this->slotHandles.resize(capacity);
+	this->handleSlots.resize(capacity);
+	this->freeHandles.reserve(capacity);
+	// reorder() swaps these with the storage, so they have to be the same size
+	this->reorderScratch.resize(capacity);
+	this->reorderHandles.resize(capacity);
+	countGrowth();
+	// new handles are handed out lowest first
+	for (int h = capacity - 1; h >= old; h--) {
+		this->handleSlots[h] = -1;
+		this->freeHandles.push_back(h);
+	}
+}
+
+Particle3D* ParticlePool::spawn() {
+	// out of room, double the storage. this only happens while the pool
+	// is growing to its working size.
+	if (this->count == (int)this->storage.size()) {
+		grow(this->storage.empty() ? 64 : this->storage.size() * 2);
+	}
+
+	// give the new particle a handle
+	int h = this->freeHandles.back();
+	this->freeHandles.pop_back();
+	this->slotHandles[this->count] = h;
+	this->handleSlots[h] = this->count;
+
+	return (Particle3D*)this->storage[this->count++].bytes;
+}
+
+void ParticlePool::push_back(Particle3D p) {
+	*spawn() = p;
+}
+
+void ParticlePool::erase(int i) {
+	if (i < 0 || i >= this->count) return;
+
+	// release the dead particle's handle
+	int h = this->slotHandles[i];
+	this->handleSlots[h] = -1;
+	this->freeHandles.push_back(h);
+
+	// move the last live particle into the hole so the live range stays packed
+	this->count--;
+	if (i != this->count) {
+		this->storage[i] = this->storage[this->count];
+		this->slotHandles[i] = this->slotHandles[this->count];
+		this->handleSlots[this->slotHandles[i]] = i;
+	}
+}
+
+void ParticlePool::clear() {
+	for (int i = 0; i < this->count; i++) {
+		this->handleSlots[this->slotHandles[i]] = -1;
+		this->freeHandles.push_back(this->slotHandles[i]);
+	}
+	this->count = 0;
+}
+
+int ParticlePool::size() {
+	return this->count;
+}
+
+int ParticlePool::capacity() {
+	return this->storage.size();
+}
+
+int ParticlePool::handle(int i) {
+	return this->slotHandles[i];
+}
+
+int ParticlePool::slot(int handle) {
+	if (handle < 0 || handle >= (int)this->handleSlots.size()) return -1;
+	return this->handleSlots[handle];
+}
+
+void ParticlePool::reorder(const uint32_t *order) {
+	// scratch is kept the same size as the storage (see grow) so the two can just be swapped afterwards
+	// gather into scratch in the new order
+	for (int i = 0; i < this->count; i++) {
+		this->reorderScratch[i] = this->storage[order[i]];
+		this->reorderHandles[i] = this->slotHandles[order[i]];
+		this->handleSlots[this->reorderHandles[i]] = i;
+	}
+	this->storage.swap(this->reorderScratch);
+	this->slotHandles.swap(this->reorderHandles);
+}
+
+Particle3D& ParticlePool::operator[](int i) {
+	return *(Particle3D*)this->storage[i].bytes;
+}
@@ -0,0 +1,77 @@
+#ifndef PARTICLEPOOL_H
+#define PARTICLEPOOL_H
+
+#include "particle3d.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+* Fixed block of particle storage which keeps all live particles packed at the front.
+* Particles are spawned into the first free slot and killed by moving the last live
+* particle into the dead one's slot, so continuous birth/death never touches the heap
+* once the pool has grown to its working size.
+* Since particles move between slots, each one also gets a handle which stays the
+* same for as long as the particle lives.
+*/
+class ParticlePool {
+public:
+	// construct the pool with room for capacity particles
+	ParticlePool(int capacity);
+
+	// returns the next free slot (growing the storage if the pool is full)
+	Particle3D* spawn();
+
+	// copies a particle into the next free slot
+	void push_back(Particle3D p);
+
+	// kills the particle at index i, the last live particle takes its place
+	void erase(int i);
+
+	// kills every particle (storage is kept)
+	void clear();
+
+	// number of live particles
+	int size();
+
+	// number of particles which fit before the pool has to grow
+	int capacity();
+
+	// handle of the particle currently at index i
+	int handle(int i);
+
+	// index of the particle with the given handle, or -1 if it has died
+	int slot(int handle);
+
+	// rearranges the live particles so that index i holds the particle which was
+	// at order[i]. order must be a permutation of [0, size()).
+	void reorder(const uint32_t *order);
+
+	Particle3D& operator[](int i);
+
+private:
+	// raw storage for one particle, so growing the pool doesn't construct (and randomize)
+	// every new slot. slots are only ever written by spawn()'s caller or copied whole.
+	class alignas(Particle3D) Slot {
+	public:
+		unsigned char bytes[sizeof(Particle3D)];
+	};
+
+	// backing storage, live particles are always in [0, count)
+	std::vector<Slot> storage;
+	int count;
+
+	// handle of the particle in each slot, and slot of each handle
+	std::vector<int> slotHandles;
+	std::vector<int> handleSlots;
+	// handles not currently given to a particle
+	std::vector<int> freeHandles;
+
+	// scratch space used when reordering
+	std::vector<Slot> reorderScratch;
+	std::vector<int> reorderHandles;
+
+	// resizes storage and handle tables to hold capacity particles
+	void grow(int capacity);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "radixsort.h"
+#include "workerpool.h"
+#include <string.h>
+#include <algorithm>
+
+// bits sorted per pass, and the number of buckets that gives
+const int RADIX_BITS = 8;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+
+// below this many keys a single thread is faster than splitting the work up
+const int PARALLEL_MIN = 1 << 16;
+// most chunks a pass will be split into
+const int MAX_CHUNKS = 16;
+
+// everything the tasks for one pass need
+class RadixPass {
+public:
+	const uint32_t *keys;
+	const uint32_t *values;
+	uint32_t *keysOut;
+	uint32_t *valuesOut;
+	int n;
+	int chunk;
+	int shift;
+	// per chunk bucket counts, which get turned into per chunk offsets
+	int counts[MAX_CHUNKS][RADIX_BUCKETS];
+};
+
+// counts how many keys in a chunk fall into each bucket for this pass
+static void countDigits(int c, void *arg) {
+	RadixPass *pass = (RadixPass*)arg;
+	int *counts = pass->counts[c];
+	int end = std::min(pass->n, (c + 1) * pass->chunk);
+	for (int b = 0; b < RADIX_BUCKETS; b++) counts[b] = 0;
+	for (int i = c * pass->chunk; i < end; i++) {
+		counts[(pass->keys[i] >> pass->shift) & (RADIX_BUCKETS - 1)]++;
+	}
+}
+
+// moves the keys in a chunk to their sorted position, counts holds the
+// next free position for each bucket
+static void scatterDigits(int c, void *arg) {
+	RadixPass *pass = (RadixPass*)arg;
+	int *offsets = pass->counts[c];
+	int end = std::min(pass->n, (c + 1) * pass->chunk);
+	for (int i = c * pass->chunk; i < end; i++) {
+		int pos = offsets[(pass->keys[i] >> pass->shift) & (RADIX_BUCKETS - 1)]++;
+		pass->keysOut[pos] = pass->keys[i];
+		pass->valuesOut[pos] = pass->values[i];
+	}
+}
+
+void radixSort(uint32_t *keys, uint32_t *values, uint32_t *keyScratch, uint32_t *valueScratch, int n, int bits) {
+	if (n < 2) return;
+
+	// work out how many chunks to split each pass into
+	WorkerPool &pool = WorkerPool::shared();
+	int chunks = 1;
+	if (n >= PARALLEL_MIN) chunks = std::min(pool.size(), MAX_CHUNKS);
+
+	RadixPass pass;
+	pass.n = n;
+	pass.chunk = (n + chunks - 1) / chunks;
+
+	uint32_t *src = keys, *srcValues = values;
+	uint32_t *dst = keyScratch, *dstValues = valueScratch;
+
+	int passes = (bits + RADIX_BITS - 1) / RADIX_BITS;
+	for (int p = 0; p < passes; p++) {
+		pass.shift = p * RADIX_BITS;
+		pass.keys = src;
+		pass.values = srcValues;
+		pass.keysOut = dst;
+		pass.valuesOut = dstValues;
+
+		// 1. count the digits in each chunk
+		pool.run(countDigits, &pass, chunks);
+
+		// 2. prefix sum, ordered by bucket then by chunk so the sort stays stable
+		int total = 0;
+		for (int b = 0; b < RADIX_BUCKETS; b++) {
+			for (int c = 0; c < chunks; c++) {
+				int count = pass.counts[c][b];
+				pass.counts[c][b] = total;
+				total += count;
+			}
+		}
+
+		// 3. each chunk scatters into place
+		pool.run(scatterDigits, &pass, chunks);
+
+		// the output of this pass is the input of the next
+		std::swap(src, dst);
+		std::swap(srcValues, dstValues);
+	}
+
+	// an odd number of passes leaves the result in the scratch arrays
+	if (src != keys) {
+		memcpy(keys, src, n * sizeof(uint32_t));
+		memcpy(values, srcValues, n * sizeof(uint32_t));
+	}
+}
+
+uint32_t floatKey(float f) {
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	// negative floats sort backwards, so flip all their bits.
+	// positive floats just need the sign bit set to go above them.
+	return (u & 0x80000000) ? ~u : (u | 0x80000000);
+}
@@ -0,0 +1,18 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <stdint.h>
+
+/**
+* Sorts n keys into ascending order with a least significant digit radix sort,
+* carrying values along with their keys. Only the lowest `bits` bits of each key
+* are looked at. The sort is stable.
+* keyScratch and valueScratch must hold n entries each; large arrays are split
+* across the shared worker pool for each pass.
+*/
+void radixSort(uint32_t *keys, uint32_t *values, uint32_t *keyScratch, uint32_t *valueScratch, int n, int bits);
+
+// converts a float to an unsigned key which sorts in the same order as the float
+uint32_t floatKey(float f);
+
+#endif
@@ -0,0 +1,136 @@
+#include "mathLib3D.h"
+#include "scenario.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+Scenario::Scenario() {
+	this->name = "default";
+	this->seed = 0;
+
+	this->minParticles = 2000;
+	this->maxParticles = 4999;
+	this->minBulk = 20;
+	this->maxBulk = 69;
+	this->maxVelocity = 2.0;
+
+	this->minRange = 0.3;
+	this->maxRange = 6.0;
+	this->minSpeed = 0.006;
+	this->maxSpeed = 0.015;
+	this->speed = 0.01;
+	this->friction = 0.0005;
+
+	this->halos = true;
+	this->walls = true;
+	this->frictionModel = FRICTION_LINEAR;
+
+	this->boxWidth = 10.0;
+	this->boxDepth = 10.0;
+
+	this->camSpeed = 0.1;
+
+	this->tickMs = 17;
+
+	this->frames = 600;
+
+	this->workers = 0;
+	this->useSockets = false;
+}
+
+bool Scenario::load(const char *path) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "%s: could not open scenario\n", path);
+		return false;
+	}
+
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(file, line)) {
+		lineNo++;
+		// allow files with windows line endings
+		if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+
+		// "a = b" reads the same as "a b"
+		for (int i = 0; i < line.size(); i++) if (line[i] == '=') line[i] = ' ';
+
+		std::istringstream in(line);
+		std::string key;
+		if (!(in >> key) || key[0] == '#') continue;
+
+		bool ok = true;
+		if (key == "name") ok = (bool)(in >> this->name);
+		else if (key == "seed") ok = (bool)(in >> this->seed);
+		else if (key == "particles") ok = (bool)(in >> this->minParticles >> this->maxParticles) && this->minParticles >= 0 && this->maxParticles >= this->minParticles;
+		else if (key == "bulk") ok = (bool)(in >> this->minBulk >> this->maxBulk) && this->minBulk >= 0 && this->maxBulk >= this->minBulk;
+		else if (key == "velocity") ok = (bool)(in >> this->maxVelocity);
+		else if (key == "range") ok = (bool)(in >> this->minRange >> this->maxRange);
+		else if (key == "speed_limits") ok = (bool)(in >> this->minSpeed >> this->maxSpeed);
+		else if (key == "speed") ok = (bool)(in >> this->speed);
+		else if (key == "friction") ok = (bool)(in >> this->friction);
+		else if (key == "halos" || key == "walls") {
+			std::string state;
+			ok = (bool)(in >> state) && (state == "on" || state == "off");
+			if (key == "halos") this->halos = (state == "on");
+			else this->walls = (state == "on");
+		} else if (key == "friction_model") {
+			std::string model;
+			ok = (bool)(in >> model) && (model == "linear" || model == "none");
+			this->frictionModel = model == "none" ? FRICTION_NONE : FRICTION_LINEAR;
+		}
+		else if (key == "box") ok = (bool)(in >> this->boxWidth >> this->boxDepth);
+		else if (key == "cam_speed") ok = (bool)(in >> this->camSpeed);
+		else if (key == "tick_ms") ok = (bool)(in >> this->tickMs);
+		else if (key == "frames") ok = (bool)(in >> this->frames);
+		else if (key == "workers") ok = (bool)(in >> this->workers);
+		else if (key == "transport") {
+			std::string transport;
+			ok = (bool)(in >> transport) && (transport == "shm" || transport == "socket");
+			this->useSockets = (transport == "socket");
+		}
+		else if (key == "emitter") {
+			ScenarioEmitter e;
+			ok = (bool)(in >> e.position.mX >> e.position.mY >> e.position.mZ >> e.rate);
+			if (ok) this->emitters.push_back(e);
+		} else if (key == "obstacle") {
+			std::string shape;
+			Point3D c;
+			ok = (bool)(in >> shape >> c.mX >> c.mY >> c.mZ);
+			if (ok && shape == "sphere") {
+				float r;
+				ok = (bool)(in >> r);
+				if (ok) this->obstacles.push_back(Obstacle::sphere(c, r));
+			} else if (ok && shape == "box") {
+				Vec3D h;
+				ok = (bool)(in >> h.mX >> h.mY >> h.mZ);
+				if (ok) this->obstacles.push_back(Obstacle::box(c, h));
+			} else ok = false;
+		} else if (key == "event") {
+			ScenarioEvent e;
+			e.down = false;
+			e.dx = 0;
+			e.dy = 0;
+			ok = (bool)(in >> e.frame >> e.type);
+			if (ok && e.type == "look") {
+				ok = (bool)(in >> e.dx >> e.dy);
+			} else if (ok && (e.type == "key" || e.type == "mouse" || e.type == "special")) {
+				std::string state;
+				ok = (bool)(in >> e.target);
+				// special keys are only ever pressed
+				if (ok && e.type != "special") {
+					ok = (bool)(in >> state) && (state == "down" || state == "up");
+					e.down = (state == "down");
+				}
+			} else ok = false;
+			if (ok) this->events.push_back(e);
+		} else ok = false;
+
+		if (!ok) {
+			fprintf(stderr, "%s:%d: could not understand '%s'\n", path, lineNo, line.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
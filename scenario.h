@@ -0,0 +1,118 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "mathLib3D.h"
+#include "kernels.h"
+#include "obstacles.h"
+#include <string>
+#include <vector>
+
+/**
+* A single scripted input, applied at the start of the given frame.
+* type is one of "key", "special", "mouse" or "look".
+*/
+class ScenarioEvent {
+public:
+	int frame;
+	std::string type;
+	// key pressed, special key (up/down) or mouse button (left/right)
+	std::string target;
+	// whether a key/button goes down or up
+	bool down;
+	// mouse offsets for look events
+	float dx;
+	float dy;
+};
+
+/**
+* An emitter to place when the scenario starts.
+*/
+class ScenarioEmitter {
+public:
+	Point3D position;
+	float rate;
+};
+
+/**
+* All of the settings which make up one simulation setup, plus an input script.
+* The defaults match the normal interactive simulation.
+*
+* Scenario files are plain text, with one setting per line as "name = values".
+* Lines starting with # are comments. For example:
+*
+*   name = dense
+*   seed = 42
+*   particles = 20000 29999
+*   box = 10 10
+*   halos = off
+*   friction_model = none
+*   frames = 600
+*   workers = 4
+*   transport = socket
+*   emitter 0 -4 5 2000
+*   obstacle sphere 0 0 5 1
+*   obstacle box 2 -2 3 0.5 0.5 0.5
+*   event 0 mouse left down
+*   event 120 look 40 0
+*   event 200 key w down
+*/
+class Scenario {
+public:
+	Scenario();
+
+	// name reported in benchmark results
+	std::string name;
+	// random seed, 0 seeds from the clock
+	unsigned int seed;
+
+	// lowest and highest number of particles in the initial spawn and added by 'G' (both inclusive)
+	int minParticles;
+	int maxParticles;
+	int minBulk;
+	int maxBulk;
+	// largest random velocity given to spawned particles
+	float maxVelocity;
+
+	// limits and starting values for particle properties
+	float minRange;
+	float maxRange;
+	float minSpeed;
+	float maxSpeed;
+	float speed;
+	float friction;
+
+	// whether affected particles get halos, whether particles bounce off the walls,
+	// and how friction slows particles down
+	bool halos;
+	bool walls;
+	FrictionModel frictionModel;
+
+	// box is boxWidth wide and high (centered on x/y = 0) and boxDepth deep (starting at z = 0)
+	float boxWidth;
+	float boxDepth;
+
+	// camera movement speed
+	float camSpeed;
+
+	// milliseconds between simulation ticks
+	int tickMs;
+
+	// number of frames a benchmark runs for
+	int frames;
+
+	// number of worker processes to split the box between (0 simulates in this process),
+	// and whether they pass particles over sockets instead of shared memory
+	int workers;
+	bool useSockets;
+
+	std::vector<ScenarioEmitter> emitters;
+	// static obstacles particles bounce off
+	std::vector<Obstacle> obstacles;
+	std::vector<ScenarioEvent> events;
+
+	// reads settings from a scenario file, leaving anything not mentioned at its current value.
+	// returns false (and prints why) if the file can't be read or has a bad line.
+	bool load(const char *path);
+};
+
+#endif
@@ -10,15 +10,34 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <math.h>
 #include <cstdlib>
 #include <ctime>
 #include <vector>
-#include <sstream>
+#include <assert.h>
+#include <string>
+#include <map>
+#include <chrono>
 #include "mathLib3D.h"
 #include "particle3d.h"
 #include "camera.h"
+#include "particlepool.h"
+#include "emitter.h"
+#include "spatialsort.h"
+#include "transparentpass.h"
+#include "scenario.h"
+#include "benchmark.h"
+#include "domain.h"
+#include "textoverlay.h"
+#include "uploadpipeline.h"
+#include "kernels.h"
+#include "obstacles.h"
+#include "framearena.h"
+#include "workerpool.h"
+#include "allocstats.h"
+#include "metrics.h"
 
 // Size of the screen, gets adjusted by the reshape func
 int screensize[] = {600, 600};
@@ -31,8 +50,32 @@ bool mouse_buttons[2] = {false, false};
 // Camera object
 Camera camera = Camera(Vec3D(0.0, 0.0, 7.0), Vec3D(0.0, 0.0, 0.0));
 
-// list of all particles
-std::vector<Particle3D> particles;
+// list of all particles (room for plenty up front so spawning doesn't have to grow it)
+ParticlePool particles = ParticlePool(100000);
+
+// list of all emitters
+std::vector<Emitter> emitters;
+
+// static obstacles particles bounce off
+ObstacleBVH obstacles;
+
+// keeps particles stored in spatial order
+SpatialSorter sorter;
+
+// translucent points drawn after everything else, sorted by depth
+TransparentPass transparents;
+
+// copies particles for drawing on another thread, a frame ahead of drawing them
+UploadPipeline uploads;
+
+// settings for the current run (box size, particle counts, limits, ...), and its input script
+Scenario scenario;
+
+// number of ticks since the scenario started, used to play back scripted input
+int frameCount = 0;
+
+// when the box is split between worker processes, this coordinates them (otherwise NULL)
+SlabDomain *domain = NULL;
 
 // these variables are used for messages displayed on screen for short durations
 // this is the number of frames to display a message for
@@ -48,15 +91,22 @@ bool paused = false;
 // central mouse positions
 float centerX = 300, centerY = 300;
 
-// maximums for various particle properties
-const float MAX_RANGE = 6.0;
-const float MIN_RANGE = 0.3;
-const float MAX_SPEED = 0.015;
-const float MIN_SPEED = 0.006;
-
 // show the instructions?
 bool show_instructions = true;
 
+// ticks before the frame loop is expected to have stopped allocating from the heap
+const int WARMUP_FRAMES = 120;
+
+// show timing stats in the corner?
+bool show_stats = false;
+// frames the stats are averaged over before the overlay is updated
+const int STATS_INTERVAL = 30;
+
+// cached text blocks for the instructions, the messages and the stats
+TextOverlay instructionsText = TextOverlay(GLUT_BITMAP_HELVETICA_18);
+TextOverlay messageText = TextOverlay(GLUT_BITMAP_HELVETICA_18);
+TextOverlay statsText = TextOverlay(GLUT_BITMAP_HELVETICA_12);
+
 // full instructions to be displayed
 const char *text_instructions = "Welcome to the Particle Animation!\n"
 "This doesn't run well on gpu1, try it locally.\n"
@@ -69,6 +119,9 @@ const char *text_instructions = "Welcome to the Particle Animation!\n"
 "The animation can be paused at any time with the space bar.\n"
 "More particles can be added in bulk with 'G',\n"
 "Or you can hit 'R' to erase all particles and start fresh.\n"
+"'E' places a particle emitter, and 'X' removes all emitters.\n"
+"'O' places an obstacle, and 'K' removes all obstacles.\n"
+"'F' toggles timing stats, and 'H' toggles halos.\n"
 "You can quit at any time by hitting 'Q' or Escape.\n\n"
 "Now click to begin!";
 
@@ -78,8 +131,8 @@ const char *text_instructions = "Welcome to the Particle Animation!\n"
 void genParticles(bool clear, int minCount, int maxCount) {
   // empty out the list
   if (clear) particles.clear();
-  // random number of particles
-  int particleCount = (rand() % maxCount) + minCount;
+  // random number of particles from minCount to maxCount (scenarios may ask for none at all)
+  int particleCount = minCount + (maxCount > minCount ? rand() % (maxCount - minCount + 1) : 0);
   // empty the avg range
   avg_range = 0;
   avg_speed = 0;
@@ -87,16 +140,18 @@ void genParticles(bool clear, int minCount, int maxCount) {
     // construct new particle
     Particle3D p = Particle3D();
     // spawn the particle in the center
-    p.position = Point3D(0, 0, 5);
+    p.position = Point3D(0, 0, scenario.boxDepth / 2);
     // randomize direction and velo
-    // assign a random direction to the particle
-    int randX = (rand() % 10) - 5;
-    int randY = (rand() % 10) - 5;
-    int randZ = (rand() % 10);
+    // assign a random direction to the particle (towards a random point in the box)
+    float randX = ((rand() % 10) - 5) * (scenario.boxWidth / 10);
+    float randY = ((rand() % 10) - 5) * (scenario.boxWidth / 10);
+    float randZ = (rand() % 10) * (scenario.boxDepth / 10);
     p.direction = Vec3D::createVector(p.position, Point3D(randX, randY, randZ)).normalize();
     // assign a random velocity to the particle
-    float randVelo = 2 * (static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
+    float randVelo = scenario.maxVelocity * (static_cast <float> (rand()) / static_cast <float> (RAND_MAX));
     p.velocity = randVelo;
+    p.speed = scenario.speed;
+    p.friction = scenario.friction;
 
     // add to list
     particles.push_back(p);
@@ -104,8 +159,47 @@ void genParticles(bool clear, int minCount, int maxCount) {
     avg_range += p.range;
     avg_speed += p.speed;
   }
-  avg_range /= particleCount;
-  avg_speed /= particleCount;
+  if (particleCount > 0) {
+    avg_range /= particleCount;
+    avg_speed /= particleCount;
+  }
+}
+
+/**
+* Spawns particles from every emitter, then ages emitted particles,
+* killing those which have outlived their lifetime.
+*/
+void updateLifetimes() {
+  for (int i = 0; i < emitters.size(); i++) {
+    emitters[i].emit(particles, i, scenario.tickMs / 1000.0);
+  }
+
+  for (int i = 0; i < particles.size(); ) {
+    Particle3D* p = &particles[i];
+    // particles without a lifetime live forever
+    if (p->lifetime <= 0) {
+      i++;
+      continue;
+    }
+    p->age += 1;
+    // dead particles are replaced by the last particle, so don't advance i
+    if (p->age >= p->lifetime) {
+      particles.erase(i);
+      continue;
+    }
+    // fade colour/size (the emitter may have been removed since)
+    if (p->emitter >= 0 && p->emitter < emitters.size()) emitters[p->emitter].fade(p);
+    i++;
+  }
+}
+
+/**
+* Removes every emitter. Particles they spawned live out their lifetimes without fading,
+* since their emitter index would otherwise point at whichever emitter is placed next.
+*/
+void clearEmitters() {
+  emitters.clear();
+  for (int i = 0; i < particles.size(); i++) particles[i].emitter = -1;
 }
 
 /**
@@ -121,102 +215,59 @@ void genParticles(bool clear, int minCount, int maxCount) {
 void computeParticleMotion() {
   // direction the camera is looking
   Point3D cp = Point3D(camera.camPos.mX + camera.camFront.mX, camera.camPos.mY + camera.camFront.mY, camera.camPos.mZ + camera.camFront.mZ);
-  for (int i = 0; i < particles.size(); i++) {
-    // get the particle as a pointer because I don't like working with long particles[i]
-    Particle3D* p = &particles[i];
-    // check if this particle is in range of the camera, and lmb is down
-    if (p->position.distanceTo(cp) <= p->range && mouse_buttons[0]) {
-      // compute the direction the particle goes in to follow the camera
-      p->direction = Vec3D::createVector(p->position, cp).normalize();
-      // increase the velocity of the particle
-      p->velocity += p->speed;
-
-      p->halo = true;
-    }
-    // check if this particle is in range of the camera, and rmb is down
-    else if (p->position.distanceTo(cp) <= p->range && mouse_buttons[1]) {
-      // compute the direction the particle goes in to go away from the camera
-      p->direction = Vec3D::createVector(cp, p->position).normalize();
-      // increase the velocity of the particle
-      p->velocity += p->speed;
-
-      // display an indicator on affected particles
-      p->halo = true;
-    } else p->halo = false; // remove indicator from unaffected particles
-    // decrease the velocity of the particle based on friction, to a minimum of 0
-    p->velocity -= ((float)(p->size) * p->friction);
-    if (p->velocity < 0) p->velocity = 0;
-  }
+  // lmb attracts, rmb repels (lmb wins if both are down)
+  ForceMode force = mouse_buttons[0] ? FORCE_ATTRACT : (mouse_buttons[1] ? FORCE_REPEL : FORCE_NONE);
+  // run the loop specialized for the current settings (see kernels.cpp)
+  runMotionKernel(force, scenario.halos, scenario.frictionModel, particles, cp);
 }
 
 /**
 * Applies motion to all particles based on their velocity and direction
 */
 void moveParticles() {
-  for (int i = 0; i < particles.size(); i++) {
-    // get the particle as a pointer because I don't like working with long particles[i]
-    Particle3D* p = &particles[i];
-    // we need to check if the particle has hit an invalid position (i.e. if it's passed through a wall)
-    float pX = p->position.mX;
-    float pY = p->position.mY;
-    float pZ = p->position.mZ;
-    // if it has passed through a wall, bounce off the wall.
-    // this is really easy to do by reversing direction on 1 axis
-    // (thank you to https://stackoverflow.com/questions/573084/how-to-calculate-bounce-angle)
-    if (pX < -4.9 || pX > 4.9) p->direction.mX *= -1; 
-    if (pY < -4.9 || pY > 4.9) p->direction.mY *= -1; 
-    if (pZ < 0.1 || pZ > 9.9) p->direction.mZ *= -1; 
-    // move the particle based on direction + velocity
-    p->position = p->direction.multiply(p->velocity).movePoint(p->position);
-  }
+  // positions particles bounce at, just inside the walls
+  float wall = (scenario.boxWidth / 2) - 0.1;
+  float depth = scenario.boxDepth - 0.1;
+  // if a particle's move takes it through a wall, it bounces off the wall.
+  // this is really easy to do by reversing direction on 1 axis
+  // (thank you to https://stackoverflow.com/questions/573084/how-to-calculate-bounce-angle)
+  // obstacles are hit anywhere along the move too, so fast particles can't tunnel through.
+  runMoveKernel(scenario.walls, particles, wall, depth, obstacles);
 }
 
 /**
-* Renders a single particle based on its properties
+* Keeps particles in spatial order, re-sorting them when locality has degraded.
 */
-void drawParticle(Particle3D p) {
-  // color the point
-  glColor3f(p.color[0], p.color[1], p.color[2]);
-  // size the point
-  glPointSize(p.size);
-
-  // render the point
-  glBegin(GL_POINTS);
-    glVertex3f(p.position.mX, p.position.mY, p.position.mZ);
-  glEnd();
-
-  // if the particle is being affected by the mouse, render a halo surrounding it.
-  if (p.halo) {
-    glColor4f(1.0, 0.0, 0.0, 0.3);
-    glPointSize(p.size+5);
-    glBegin(GL_POINTS);
-      glVertex3f(p.position.mX, p.position.mY, p.position.mZ);
-    glEnd();
-  }
+void sortParticles() {
+  sorter.update(particles);
 }
 
 /**
 * Main rendering of the particle simulation.
 */
 void particleSim() {
-    // iterate over all particles to be rendered
-    for (int i = 0; i < particles.size(); i++) {
-      drawParticle(particles[i]);
-    }
+    // draw the particles uploaded last tick. halos are translucent so they get drawn later in depth order.
+    transparents.clear();
+    transparents.reserve(particles.capacity());
+    uploads.draw(transparents);
 }
 
 /**
 * Draws the 6 walls which will contain all particles.
 */
 void drawWalls() {
+  // half the width of the box, and its depth
+  float w = scenario.boxWidth / 2;
+  float d = scenario.boxDepth;
+
   // front wall
   glPushMatrix();
     glColor3f(1.0, 1.0, 1.0);
     glBegin(GL_QUADS);
-      glVertex3f(-5.0, -5.0, 0.0);
-      glVertex3f(-5.0, 5.0, 0.0);
-      glVertex3f(5.0, 5.0, 0.0);
-      glVertex3f(5.0, -5.0, 0.0);
+      glVertex3f(-w, -w, 0.0);
+      glVertex3f(-w, w, 0.0);
+      glVertex3f(w, w, 0.0);
+      glVertex3f(w, -w, 0.0);
     glEnd();
   glPopMatrix();
 
@@ -224,10 +275,10 @@ void drawWalls() {
   glPushMatrix();
     glColor3f(1.0, 1.0, 1.0);
     glBegin(GL_QUADS);
-      glVertex3f(-5.0, -5.0, 10.0);
-      glVertex3f(-5.0, 5.0, 10.0);
-      glVertex3f(5.0, 5.0, 10.0);
-      glVertex3f(5.0, -5.0, 10.0);
+      glVertex3f(-w, -w, d);
+      glVertex3f(-w, w, d);
+      glVertex3f(w, w, d);
+      glVertex3f(w, -w, d);
     glEnd();
   glPopMatrix();
 
@@ -235,10 +286,10 @@ void drawWalls() {
   glPushMatrix();
     glColor3f(0.0, 0.0, 0.0);
     glBegin(GL_QUADS);
-      glVertex3f(-5.0, -5.0, 0.0);
-      glVertex3f(-5.0, -5.0, 10.0);
-      glVertex3f(-5.0, 5.0, 10.0);
-      glVertex3f(-5.0, 5.0, 0.0);
+      glVertex3f(-w, -w, 0.0);
+      glVertex3f(-w, -w, d);
+      glVertex3f(-w, w, d);
+      glVertex3f(-w, w, 0.0);
     glEnd();
   glPopMatrix();
 
@@ -246,10 +297,10 @@ void drawWalls() {
   glPushMatrix();
     glColor3f(0.0, 0.0, 0.0);
     glBegin(GL_QUADS);
-      glVertex3f(5.0, -5.0, 0.0);
-      glVertex3f(5.0, -5.0, 10.0);
-      glVertex3f(5.0, 5.0, 10.0);
-      glVertex3f(5.0, 5.0, 0.0);
+      glVertex3f(w, -w, 0.0);
+      glVertex3f(w, -w, d);
+      glVertex3f(w, w, d);
+      glVertex3f(w, w, 0.0);
     glEnd();
   glPopMatrix();
 
@@ -257,10 +308,10 @@ void drawWalls() {
   glPushMatrix();
     glColor3f(0.0, 0.0, 0.0);
     glBegin(GL_QUADS);
-      glVertex3f(-5.0, 5.0, 10.0);
-      glVertex3f(5.0, 5.0, 10.0);
-      glVertex3f(5.0, 5.0, 0.0);
-      glVertex3f(-5.0, 5.0, 0.0);
+      glVertex3f(-w, w, d);
+      glVertex3f(w, w, d);
+      glVertex3f(w, w, 0.0);
+      glVertex3f(-w, w, 0.0);
     glEnd();
   glPopMatrix();
 
@@ -268,10 +319,10 @@ void drawWalls() {
   glPushMatrix();
     glColor3f(0.0, 0.0, 0.0);
     glBegin(GL_QUADS);
-      glVertex3f(-5.0, -5.0, 10.0);
-      glVertex3f(5.0, -5.0, 10.0);
-      glVertex3f(5.0, -5.0, 0.0);
-      glVertex3f(-5.0, -5.0, 0.0);
+      glVertex3f(-w, -w, d);
+      glVertex3f(w, -w, d);
+      glVertex3f(w, -w, 0.0);
+      glVertex3f(-w, -w, 0.0);
     glEnd();
   glPopMatrix();
 }
@@ -283,15 +334,36 @@ void instructions() {
   glColor3f(1, 1, 1);
 
   glRasterPos2f(-1, 0.7);
-  glutBitmapString(GLUT_BITMAP_HELVETICA_18, reinterpret_cast<const unsigned char *>(text_instructions));
+  instructionsText.setText(text_instructions);
+  instructionsText.draw();
+}
+
+/**
+* Draws the obstacles as wireframes so particles behind them stay visible.
+*/
+void drawObstacles() {
+  glColor3f(0.6, 0.6, 0.6);
+  for (int i = 0; i < obstacles.size(); i++) {
+    Obstacle &o = obstacles[i];
+    glPushMatrix();
+      glTranslatef(o.center.mX, o.center.mY, o.center.mZ);
+      if (o.shape == OBSTACLE_SPHERE) {
+        glutWireSphere(o.radius, 16, 12);
+      } else {
+        glScalef(o.halfSize.mX * 2, o.halfSize.mY * 2, o.halfSize.mZ * 2);
+        glutWireCube(1.0);
+      }
+    glPopMatrix();
+  }
 }
 
 /**
 * Contains rendering steps for shapes and particles.
 */
 void shapeRender() {
-  // draw the box and all particles.
+  // draw the box, obstacles and all particles.
   drawWalls();
+  drawObstacles();
   particleSim();
 }
 
@@ -304,36 +376,93 @@ void cameraMovement() {
   // enforce boundaries for camera positioning based on the walls
   // this is a terrible way to implement this but it doesn't matter,
   // the walls are fixed location and the only solid objects in the scene.
-  if (camera.camPos.mX > 4.7) camera.camPos.mX = 4.7;
-  if (camera.camPos.mY > 4.7) camera.camPos.mY = 4.7;
-  if (camera.camPos.mZ > 9.7) camera.camPos.mZ = 9.7;
-  if (camera.camPos.mX < -4.7) camera.camPos.mX = -4.7;
-  if (camera.camPos.mY < -4.7) camera.camPos.mY = -4.7;
-  if (camera.camPos.mZ < 0.3) camera.camPos.mZ = 0.3;
+  float wall = (scenario.boxWidth / 2) - 0.3;
+  float depth = scenario.boxDepth - 0.3;
+  camera.clampPosition(Point3D(-wall, -wall, 0.3), Point3D(wall, wall, depth));
 
   camera.applyRotation();
 }
 
 void messageRender() {
+  // values the message text was last built from
+  static float shownRange = -1, shownSpeed = -1;
+  static int shownCount = -1;
+  static bool shownPaused = false;
+
   // this will show a message iff variables have been changed, to provide info to user
   if (renderFrames > 0) {
     // direction of the message to be rendered
     Point3D cp = Point3D(camera.camPos.mX + camera.camFront.mX, camera.camPos.mY + camera.camFront.mY, camera.camPos.mZ + camera.camFront.mZ);
-    std::stringstream stream;
-    stream << "Average particle range: " << avg_range << "\nAverage particle speed: " << avg_speed << "\nParticle count: " << particles.size();
-    std::string output = stream.str();
-    if (paused) output = "Animation Paused\n\n" + output;
+
+    // only rebuild the text if something in it has changed
+    if (avg_range != shownRange || avg_speed != shownSpeed || particles.size() != shownCount || paused != shownPaused) {
+      char output[256];
+      if (domain != NULL) {
+        // the only messages in this mode come from keys which are turned off (see handleKeyboard)
+        snprintf(output, sizeof(output), "%sParticles, emitters and obstacles can't be changed\nwhile the box is split between worker processes",
+          paused ? "Animation Paused\n\n" : "");
+      } else {
+        snprintf(output, sizeof(output), "%sAverage particle range: %g\nAverage particle speed: %g\nParticle count: %d",
+          paused ? "Animation Paused\n\n" : "", avg_range, avg_speed, particles.size());
+      }
+      messageText.setText(output);
+
+      shownRange = avg_range;
+      shownSpeed = avg_speed;
+      shownCount = particles.size();
+      shownPaused = paused;
+    }
 
     glColor4f(1, 0, 0, 0.8);
 
     glRasterPos3f(cp.mX, cp.mY, cp.mZ);
-    glutBitmapString(GLUT_BITMAP_HELVETICA_18, reinterpret_cast<const unsigned char *>
-      (output.c_str()));
+    messageText.draw();
 
     renderFrames--;
   }
 }
 
+/**
+* Draws the timing stats in the top left corner of the window.
+*/
+void statsRender() {
+  if (!show_stats) return;
+
+  // draw straight onto the screen, on top of everything
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glDisable(GL_DEPTH_TEST);
+
+  glColor3f(1, 1, 0);
+  glRasterPos2f(-0.98, 0.95);
+  statsText.draw();
+
+  glEnable(GL_DEPTH_TEST);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+/**
+* When counting allocations, checks nothing has been allocated since `before`, once warmed up.
+* Frames where a pool, arena or draw buffer grew (growthCount() moved on from `growths`)
+* aren't steady state, so are let off.
+*/
+void checkAllocations(long before, long growths) {
+#ifdef COUNT_ALLOCATIONS
+  if (frameCount > WARMUP_FRAMES && growthCount() == growths) {
+    long count = allocationCount() - before;
+    if (count != 0) fprintf(stderr, "%ld heap allocations in a steady state frame\n", count);
+    assert(count == 0);
+  }
+#endif
+}
+
 /************************************
 * Bunch of glut callbacks below here
 *************************************/
@@ -342,6 +471,9 @@ void messageRender() {
 * Display callback, just renders stuff and swaps buffers
 */
 void display(void) {
+  long allocations = allocationCount();
+  long growths = growthCount();
+
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   if (show_instructions) {
@@ -351,16 +483,45 @@ void display(void) {
     camera.lookAt();
 
     shapeRender();
+    transparents.draw(camera, screensize[1]);
     messageRender();
+    statsRender();
   }
 
   glutSwapBuffers();
+
+  // everything allocated from the arena this frame is done with
+  threadArena().reset();
+  if (!show_instructions) checkAllocations(allocations, growths);
+}
+
+/**
+* Reshape callback, keeps the viewport and camera projection matching the window
+*/
+void reshape(int w, int h) {
+  if (h == 0) h = 1;
+  screensize[0] = w;
+  screensize[1] = h;
+  glViewport(0, 0, w, h);
+  camera.setAspect((float)w / h);
+
+  // keep warping the mouse back to the middle of the window
+  centerX = w / 2;
+  centerY = h / 2;
 }
 
 /**
 * Handles regular keyboard inputs (e.g. w/s/a/d for movement)
 */
 void handleKeyboard(unsigned char key, int _x, int _y) {
+  // particles can't change while they're being uploaded
+  uploads.finish();
+  // with the box split between worker processes the particles, emitters and obstacles live
+  // in the workers, so keys which edit them would be thrown away. say so instead.
+  if (domain != NULL && key != '\0' && strchr("rgnmeokx+-", key) != NULL) {
+    renderFrames = 60;
+    return;
+  }
   if (!paused) {
     switch(key) {
       case 'w':
@@ -386,13 +547,54 @@ void handleKeyboard(unsigned char key, int _x, int _y) {
       case 'r':
       {
         // r key regenerates particles from scratch
-        genParticles(true, 2000, 3000);
+        genParticles(true, scenario.minParticles, scenario.maxParticles);
         break;
       }
       case 'g':
       {
         // g key generates some new particles
-        genParticles(false, 20, 50);
+        genParticles(false, scenario.minBulk, scenario.maxBulk);
+        break;
+      }
+      case 'e':
+      {
+        // e key places an emitter in front of the camera
+        Point3D cp = Point3D(camera.camPos.mX + camera.camFront.mX, camera.camPos.mY + camera.camFront.mY, camera.camPos.mZ + camera.camFront.mZ);
+        emitters.push_back(Emitter(cp));
+        break;
+      }
+      case 'o':
+      {
+        // o key places a spherical obstacle a little in front of the camera
+        Point3D op = Point3D(camera.camPos.mX + (camera.camFront.mX * 2), camera.camPos.mY + (camera.camFront.mY * 2), camera.camPos.mZ + (camera.camFront.mZ * 2));
+        obstacles.add(Obstacle::sphere(op, 0.5));
+        break;
+      }
+      case 'k':
+      {
+        // k key removes all obstacles
+        obstacles.clear();
+        break;
+      }
+      case 'f':
+      {
+        // f key shows/hides the timing stats
+        show_stats = !show_stats;
+        break;
+      }
+      case 'h':
+      {
+        // h key turns halos on/off (clearing any left over when turning them off)
+        scenario.halos = !scenario.halos;
+        if (!scenario.halos) {
+          for (int i = 0; i < particles.size(); i++) particles[i].halo = false;
+        }
+        break;
+      }
+      case 'x':
+      {
+        // x key removes all emitters, their particles die off naturally
+        clearEmitters();
         break;
       }
       case 'n':
@@ -417,7 +619,7 @@ void handleKeyboard(unsigned char key, int _x, int _y) {
               closest = i;
             }
           }
-          particles.erase(particles.begin() + closest);
+          particles.erase(closest);
         }
       }
       case '+':
@@ -425,10 +627,10 @@ void handleKeyboard(unsigned char key, int _x, int _y) {
         // will show the user the change to overall average range
         renderFrames = 60;
         avg_range = 0;
-        // increase range for all particles to a max of 5.0
+        // increase range for all particles up to the maximum
         for (int i = 0; i < particles.size(); i++) {
           particles[i].range += 0.13;
-          if (particles[i].range > MAX_RANGE) particles[i].range = MAX_RANGE;
+          if (particles[i].range > scenario.maxRange) particles[i].range = scenario.maxRange;
           avg_range += particles[i].range;
         }
         // take the average
@@ -443,7 +645,7 @@ void handleKeyboard(unsigned char key, int _x, int _y) {
         // reduce range by a fixed amount for all particles
         for (int i = 0; i < particles.size(); i++) {
           particles[i].range -= 0.13;
-          if (particles[i].range < MIN_RANGE) particles[i].range = MIN_RANGE;
+          if (particles[i].range < scenario.minRange) particles[i].range = scenario.minRange;
           avg_range += particles[i].range;
         }
         // take the average
@@ -464,6 +666,13 @@ void handleKeyboard(unsigned char key, int _x, int _y) {
 * Handle arrow key inputs.
 */
 void special(int key, int x, int y) {
+  // particles can't change while they're being uploaded
+  uploads.finish();
+  // speed changes would only reach the coordinator's copy of the particles (see handleKeyboard)
+  if (domain != NULL) {
+    renderFrames = 60;
+    return;
+  }
   if (!show_instructions && !paused) {
     switch(key) {
       case GLUT_KEY_UP:
@@ -473,7 +682,7 @@ void special(int key, int x, int y) {
         avg_speed = 0;
         for (int i = 0; i < particles.size(); i++) {
           particles[i].speed += 0.002;
-          if (particles[i].speed > MAX_SPEED) particles[i].speed = MAX_SPEED;
+          if (particles[i].speed > scenario.maxSpeed) particles[i].speed = scenario.maxSpeed;
           avg_speed += particles[i].speed;
         }
         avg_speed /= particles.size();
@@ -486,7 +695,7 @@ void special(int key, int x, int y) {
         avg_speed = 0;
         for (int i = 0; i < particles.size(); i++) {
           particles[i].speed -= 0.002;
-          if (particles[i].speed < MIN_SPEED) particles[i].speed = MIN_SPEED;
+          if (particles[i].speed < scenario.minSpeed) particles[i].speed = scenario.minSpeed;
           avg_speed += particles[i].speed;
         }
         avg_speed /= particles.size();
@@ -556,24 +765,391 @@ void mouseMotion(int x, int y) {
   glutWarpPointer(centerX, centerY);
 }
 
+/**
+* Applies any scripted input from the scenario which is due on this frame.
+*/
+void playEvents(int frame) {
+  for (int i = 0; i < scenario.events.size(); i++) {
+    ScenarioEvent &e = scenario.events[i];
+    if (e.frame != frame) continue;
+
+    if (e.type == "key") {
+      if (e.down) handleKeyboard(e.target[0], 0, 0);
+      else handleKeyboardUp(e.target[0], 0, 0);
+    } else if (e.type == "special") {
+      special(e.target == "up" ? GLUT_KEY_UP : GLUT_KEY_DOWN, 0, 0);
+    } else if (e.type == "mouse") {
+      mouse_buttons[e.target == "left" ? 0 : 1] = e.down;
+    } else if (e.type == "look") {
+      camera.updateRotation(e.dx, e.dy);
+    }
+  }
+}
+
+/**
+* Simulates one step of a worker process's slab, using the coordinator's camera/mouse input.
+*/
+void workerStep(int worker, const DomainInput &input) {
+  camera.camPos = Vec3D(input.camPos[0], input.camPos[1], input.camPos[2]);
+  camera.camFront = Vec3D(input.camFront[0], input.camFront[1], input.camFront[2]);
+  camera.markDirty();
+  mouse_buttons[0] = input.mouseButtons[0];
+  mouse_buttons[1] = input.mouseButtons[1];
+  // follow the coordinator's halo toggle, clearing any left over when it's turned off
+  if (scenario.halos && !input.halos) {
+    for (int i = 0; i < particles.size(); i++) particles[i].halo = false;
+  }
+  scenario.halos = input.halos;
+
+  // every worker has a copy of every emitter, only run the ones in this slab
+  for (int i = 0; i < emitters.size(); i++) {
+    emitters[i].active = domain->slabOf(emitters[i].position.mX) == worker;
+  }
+
+  updateLifetimes();
+  computeParticleMotion();
+  moveParticles();
+  sortParticles();
+}
+
+/**
+* Runs one step on all worker processes.
+*/
+void stepDomain() {
+  DomainInput input;
+  input.camPos[0] = camera.camPos.mX;
+  input.camPos[1] = camera.camPos.mY;
+  input.camPos[2] = camera.camPos.mZ;
+  input.camFront[0] = camera.camFront.mX;
+  input.camFront[1] = camera.camFront.mY;
+  input.camFront[2] = camera.camFront.mZ;
+  input.mouseButtons[0] = mouse_buttons[0];
+  input.mouseButtons[1] = mouse_buttons[1];
+  input.halos = scenario.halos;
+
+  if (!domain->step(input)) exit(1);
+}
+
+/**
+* Collects particles from all worker processes for rendering.
+*/
+void gatherDomain() {
+  domain->gather(particles);
+}
+
+/**
+* Splits the current particles between worker processes if the scenario asks for it.
+*/
+void startDomain() {
+  if (scenario.workers <= 0) return;
+  domain = new SlabDomain(scenario.workers, -scenario.boxWidth / 2, scenario.boxWidth / 2, scenario.useSockets);
+  if (!domain->start(particles, workerStep)) exit(1);
+}
+
+/**
+* Shuts down any worker processes.
+*/
+void stopDomain() {
+  delete domain;
+  domain = NULL;
+}
+
+// a part of the simulation tick which gets timed on its own
+struct Stage {
+  const char *name;
+  void (*run)();
+};
+
+// stages of a tick when simulating in this process
+const int LOCAL_STAGE_COUNT = 5;
+const Stage LOCAL_STAGES[LOCAL_STAGE_COUNT] = {
+  {"camera", cameraMovement}, {"lifetimes", updateLifetimes}, {"motion", computeParticleMotion},
+  {"move", moveParticles}, {"sort", sortParticles}};
+
+// stages of a tick when the box is split between worker processes
+const int DOMAIN_STAGE_COUNT = 3;
+const Stage DOMAIN_STAGES[DOMAIN_STAGE_COUNT] = {
+  {"camera", cameraMovement}, {"workers", stepDomain}, {"gather", gatherDomain}};
+
+// most stages any kind of tick has
+const int MAX_STAGES = 5;
+
+/**
+* Returns the stages making up a tick for the current run, and sets count to how many there are.
+*/
+const Stage* currentStages(int &count) {
+  count = domain != NULL ? DOMAIN_STAGE_COUNT : LOCAL_STAGE_COUNT;
+  return domain != NULL ? DOMAIN_STAGES : LOCAL_STAGES;
+}
+
+// ids of the exported metrics (see startMetrics), -1 while they aren't exported
+int stageMetrics[MAX_STAGES] = {-1, -1, -1, -1, -1};
+int framesMetric = -1;
+int particlesGauge = -1, activeGauge = -1, asleepGauge = -1, emittersGauge = -1, obstaclesGauge = -1;
+int haloQueueGauge = -1, transitQueueGauge = -1, allocationsGauge = -1;
+
+/**
+* Runs one tick of the simulation, adding the time taken by each stage (in ms) to stageMs.
+*/
+void simulateFrame(double stageMs[]) {
+  int count;
+  const Stage *stages = currentStages(count);
+  bool exporting = Metrics::shared().running();
+  for (int s = 0; s < count; s++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    stages[s].run();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stageMs[s] += ms;
+    if (exporting) Metrics::shared().observe(stageMetrics[s], ms);
+  }
+  if (exporting) Metrics::shared().count(framesMetric, 1);
+}
+
+/**
+* Starts serving metrics on a loopback port or Unix socket path (see Metrics).
+*/
+void startMetrics(const char *address) {
+  Metrics &metrics = Metrics::shared();
+  int count;
+  const Stage *stages = currentStages(count);
+  for (int s = 0; s < count; s++) {
+    stageMetrics[s] = metrics.addHistogram("particles_stage_seconds", "Time taken by each stage of a simulation tick.", stages[s].name);
+  }
+  uploads.setFillMetric(metrics.addHistogram("particles_upload_seconds", "Time the upload thread takes to copy a tick's vertices.", NULL));
+  framesMetric = metrics.addCounter("particles_frames_total", "Simulation ticks run.");
+  particlesGauge = metrics.addGauge("particles_count", "Live particles.");
+  activeGauge = metrics.addGauge("particles_active", "Particles which are moving.");
+  asleepGauge = metrics.addGauge("particles_asleep", "Particles which have come to rest.");
+  emittersGauge = metrics.addGauge("particles_emitters", "Particle emitters placed.");
+  obstaclesGauge = metrics.addGauge("particles_obstacles", "Obstacles placed.");
+  haloQueueGauge = metrics.addGauge("particles_halo_queue", "Halos queued to be drawn in depth order.");
+  transitQueueGauge = metrics.addGauge("particles_transit_queue", "Particles held back by worker processes because the link to a neighbour was full.");
+  if (allocationCounting()) {
+    allocationsGauge = metrics.addGauge("particles_heap_allocations", "Heap allocations made since the program started.");
+  }
+  if (!metrics.start(address)) exit(1);
+}
+
+/**
+* Stops serving metrics.
+*/
+void stopMetrics() {
+  Metrics::shared().stop();
+}
+
+/**
+* Sets the metrics gauges, if a scrape is waiting for them. Counting active particles
+* means a pass over the pool, so it's only done when someone is asking.
+*/
+void sampleMetrics() {
+  Metrics &metrics = Metrics::shared();
+  if (!metrics.running() || !metrics.wantsSample()) return;
+
+  int active = 0;
+  for (int i = 0; i < particles.size(); i++) {
+    if (particles[i].velocity > 0) active++;
+  }
+  metrics.setGauge(particlesGauge, particles.size());
+  metrics.setGauge(activeGauge, active);
+  metrics.setGauge(asleepGauge, particles.size() - active);
+  metrics.setGauge(emittersGauge, emitters.size());
+  metrics.setGauge(obstaclesGauge, obstacles.size());
+  metrics.setGauge(haloQueueGauge, transparents.size());
+  metrics.setGauge(transitQueueGauge, domain != NULL ? domain->queued() : 0);
+  metrics.setGauge(allocationsGauge, allocationCount());
+  metrics.sampled();
+}
+
+/**
+* Resets the simulation and sets it up as described by the current scenario.
+*/
+void startScenario() {
+  // seed random number generator
+  srand(scenario.seed != 0 ? scenario.seed : time(NULL));
+
+  camera = Camera(Vec3D(0.0, 0.0, 7.0), Vec3D(0.0, 0.0, 0.0));
+  camera.camSpeed = scenario.camSpeed;
+  sorter.setBounds(Point3D(-scenario.boxWidth / 2, -scenario.boxWidth / 2, 0),
+    scenario.boxWidth > scenario.boxDepth ? scenario.boxWidth : scenario.boxDepth);
+
+  for (int i = 0; i < 4; i++) keys_down[i] = false;
+  mouse_buttons[0] = mouse_buttons[1] = false;
+  paused = false;
+  frameCount = 0;
+
+  clearEmitters();
+  for (int i = 0; i < scenario.emitters.size(); i++) {
+    Emitter e = Emitter(scenario.emitters[i].position);
+    e.rate = scenario.emitters[i].rate;
+    emitters.push_back(e);
+  }
+
+  obstacles.clear();
+  for (int i = 0; i < scenario.obstacles.size(); i++) obstacles.add(scenario.obstacles[i]);
+
+  // come up with a random particle count
+  genParticles(true, scenario.minParticles, scenario.maxParticles);
+}
+
+/**
+* Runs every scenario in a directory without opening a window, and writes
+* how long each took as JSON (compared against a baseline if given).
+*/
+int runBenchmarks(const char *dir, const char *baselinePath, const char *outPath) {
+  std::vector<std::string> files = listScenarios(dir);
+  if (files.empty()) {
+    fprintf(stderr, "%s: no scenario files found\n", dir);
+    return 1;
+  }
+
+  std::map<std::string, double> baseline;
+  if (baselinePath != NULL && !loadBaseline(baselinePath, baseline)) {
+    fprintf(stderr, "%s: could not read baseline\n", baselinePath);
+    return 1;
+  }
+
+  // there's no window, so nothing is waiting for a click to start
+  show_instructions = false;
+
+  std::vector<BenchResult> results;
+  for (int f = 0; f < files.size(); f++) {
+    scenario = Scenario();
+    if (!scenario.load(files[f].c_str())) return 1;
+    startScenario();
+    startDomain();
+    // start the worker threads now rather than part way through the run
+    WorkerPool::shared();
+
+    BenchResult result;
+    result.name = scenario.name;
+    result.frames = scenario.frames;
+    double stageMs[MAX_STAGES] = {0};
+
+    long allocations = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (frameCount = 0; frameCount < scenario.frames; frameCount++) {
+      long before = allocationCount();
+      playEvents(frameCount);
+      simulateFrame(stageMs);
+      threadArena().reset();
+      if (frameCount >= WARMUP_FRAMES) allocations += allocationCount() - before;
+    }
+    result.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    result.particles = particles.size();
+    int stageCount;
+    const Stage *stages = currentStages(stageCount);
+    for (int s = 0; s < stageCount; s++) {
+      result.stageNames.push_back(stages[s].name);
+      result.stageMs.push_back(stageMs[s]);
+    }
+    stopDomain();
+    if (baseline.count(result.name)) result.baselineMsPerFrame = baseline[result.name];
+    if (allocationCounting()) result.allocations = allocations;
+    results.push_back(result);
+
+    fprintf(stderr, "%s: %.3f ms/frame\n", result.name.c_str(), result.msPerFrame());
+  }
+
+  if (!writeResults(outPath, results)) {
+    fprintf(stderr, "%s: could not write results\n", outPath);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+* Rebuilds the stats overlay from stage timings summed over the last STATS_INTERVAL frames.
+*/
+void updateStats(double stageMs[], int frames) {
+  int count;
+  const Stage *stages = currentStages(count);
+
+  char text[512];
+  int len = snprintf(text, sizeof(text), "particles: %d\n", particles.size());
+  double total = 0;
+  for (int s = 0; s < count && len < sizeof(text); s++) {
+    len += snprintf(text + len, sizeof(text) - len, "%s: %.3f ms\n", stages[s].name, stageMs[s] / frames);
+    total += stageMs[s];
+  }
+  if (len < sizeof(text)) snprintf(text + len, sizeof(text) - len, "total: %.3f ms", total / frames);
+
+  statsText.setText(text);
+}
+
 void FPS(int val) {
+  // stage timings summed since the stats were last updated
+  static double stageMs[MAX_STAGES] = {0};
+  static int statFrames = 0;
+
+  long allocations = allocationCount();
+  long growths = growthCount();
+
+  // wait for last tick's upload before changing the particles again
+  uploads.finish();
+
+  playEvents(frameCount++);
   if (!paused) {
-    cameraMovement();
-    computeParticleMotion();
-    moveParticles();
+    simulateFrame(stageMs);
+    // copy the new state for drawing while this frame draws the last one
+    uploads.begin(particles);
+    if (++statFrames == STATS_INTERVAL) {
+      updateStats(stageMs, statFrames);
+      for (int s = 0; s < MAX_STAGES; s++) stageMs[s] = 0;
+      statFrames = 0;
+    }
   }
+  sampleMetrics();
+  // everything allocated from the arena this tick is done with
+  threadArena().reset();
+  checkAllocations(allocations, growths);
+
   glutPostRedisplay();
-  glutTimerFunc(17, FPS, val);
+  glutTimerFunc(scenario.tickMs, FPS, val);
 }
 
 /* main function - program entry point */
 int main(int argc, char** argv)
 {
-  // seed random number generator
-  srand(time(NULL));
+  // command line options:
+  // --scenario <file>  run the interactive simulation with the settings/script in a scenario file
+  // --bench <dir>      run every scenario in a directory headless and report timings
+  // --baseline <file>  results from an earlier --bench run to compare against
+  // --out <file>       where to write benchmark results (defaults to stdout)
+  // --workers <n>      split the box between n worker processes
+  // --transport <t>    how workers pass particles to each other, shm (default) or socket
+  // --metrics <addr>   serve Prometheus metrics on a loopback port, or a Unix socket at a path
+  const char *scenarioPath = NULL, *benchDir = NULL, *baselinePath = NULL, *outPath = "-", *metricsAddress = NULL;
+  int workers = -1;
+  std::string transport;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--scenario") scenarioPath = argv[i + 1];
+    else if (arg == "--bench") benchDir = argv[i + 1];
+    else if (arg == "--baseline") baselinePath = argv[i + 1];
+    else if (arg == "--out") outPath = argv[i + 1];
+    else if (arg == "--workers") workers = atoi(argv[i + 1]);
+    else if (arg == "--transport") transport = argv[i + 1];
+    else if (arg == "--metrics") metricsAddress = argv[i + 1];
+  }
+
+  if (benchDir != NULL) return runBenchmarks(benchDir, baselinePath, outPath);
 
-  // come up with a random particle count (2000 - 3000)
-  genParticles(true, 2000, 3000);
+  if (scenarioPath != NULL && !scenario.load(scenarioPath)) return 1;
+  if (workers >= 0) scenario.workers = workers;
+  if (!transport.empty()) scenario.useSockets = (transport == "socket");
+  startScenario();
+
+  // workers are forked before any window/GL state exists
+  startDomain();
+  atexit(stopDomain);
+  // start the worker threads now rather than part way through the frame loop
+  WorkerPool::shared();
+  // after the workers are forked, so they don't get a copy of the server
+  if (metricsAddress != NULL) {
+    startMetrics(metricsAddress);
+    atexit(stopMetrics);
+  }
 
   glutInit(&argc, argv);
   glutInitDisplayMode(GLUT_DOUBLE);
@@ -592,6 +1168,9 @@ int main(int argc, char** argv)
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+  // needs the GL context to check what kind of buffers can be used
+  uploads.init();
+
   glutKeyboardFunc(handleKeyboard);
   glutKeyboardUpFunc(handleKeyboardUp);
   glutSpecialFunc(special);
@@ -599,7 +1178,8 @@ int main(int argc, char** argv)
   glutMotionFunc(mouseMotion);
   glutPassiveMotionFunc(mouseMotion); 
   glutDisplayFunc(display);
-  glutTimerFunc(17, FPS, 0);
+  glutReshapeFunc(reshape);
+  glutTimerFunc(scenario.tickMs, FPS, 0);
 
   glutMainLoop();
 
@@ -0,0 +1,100 @@
+#include "mathLib3D.h"
+#include "particlepool.h"
+#include "radixsort.h"
+#include "spatialsort.h"
+#include "framearena.h"
+
+// bits of each axis used in the morton code
+const int MORTON_BITS = 10;
+// pairs of particles looked at when measuring locality
+const int LOCALITY_SAMPLES = 1024;
+
+SpatialSorter::SpatialSorter() {
+	this->checkInterval = 30;
+	this->threshold = 2.0;
+	this->frames = 0;
+	this->sortedLocality = 0;
+	setBounds(Point3D(-5.0, -5.0, 0.0), 10.0);
+}
+
+void SpatialSorter::setBounds(Point3D min, float size) {
+	this->boxMin[0] = min.mX;
+	this->boxMin[1] = min.mY;
+	this->boxMin[2] = min.mZ;
+	this->boxSize = size;
+}
+
+// spreads the lower 10 bits of v out so there are 2 zero bits between each
+static uint32_t spreadBits(uint32_t v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+// maps a coordinate between min and min + size to [0, 1023]
+static uint32_t quantize(float v, float min, float size) {
+	float t = (v - min) / size;
+	if (t < 0) t = 0;
+	if (t > 1) t = 1;
+	return (uint32_t)(t * ((1 << MORTON_BITS) - 1));
+}
+
+uint32_t SpatialSorter::mortonCode(Point3D p) {
+	return spreadBits(quantize(p.mX, this->boxMin[0], this->boxSize))
+		| (spreadBits(quantize(p.mY, this->boxMin[1], this->boxSize)) << 1)
+		| (spreadBits(quantize(p.mZ, this->boxMin[2], this->boxSize)) << 2);
+}
+
+float SpatialSorter::locality(ParticlePool &pool) {
+	int n = pool.size();
+	if (n < 2) return 0;
+
+	// look at evenly spaced pairs of neighbours rather than every particle
+	int step = (n - 1) / LOCALITY_SAMPLES;
+	if (step < 1) step = 1;
+
+	float total = 0;
+	int samples = 0;
+	for (int i = 0; i + 1 < n; i += step) {
+		total += pool[i].position.fastDistanceTo(pool[i + 1].position);
+		samples++;
+	}
+	return total / samples;
+}
+
+void SpatialSorter::sort(ParticlePool &pool) {
+	int n = pool.size();
+
+	// keys and the new order are only needed until the pool is reordered
+	FrameArena &arena = threadArena();
+	uint32_t *keys = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *order = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *keyScratch = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *orderScratch = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	for (int i = 0; i < n; i++) {
+		keys[i] = mortonCode(pool[i].position);
+		order[i] = i;
+	}
+
+	radixSort(keys, order, keyScratch, orderScratch, n, 3 * MORTON_BITS);
+	pool.reorder(order);
+
+	this->sortedLocality = locality(pool);
+	this->frames = 0;
+}
+
+bool SpatialSorter::update(ParticlePool &pool) {
+	if (++this->frames < this->checkInterval) return false;
+	this->frames = 0;
+
+	// re-sort once particles have drifted far enough from their sorted order
+	// (the small constant stops a near-zero sorted locality always triggering this)
+	if (locality(pool) > (this->sortedLocality * this->threshold) + 0.01) {
+		sort(pool);
+		return true;
+	}
+	return false;
+}
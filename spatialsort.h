@@ -0,0 +1,51 @@
+#ifndef SPATIALSORT_H
+#define SPATIALSORT_H
+
+#include "mathLib3D.h"
+#include "particlepool.h"
+#include <stdint.h>
+
+/**
+* Keeps particles stored in Morton (Z-order) order of their positions, so particles
+* which are close together in the box are also close together in memory.
+* Rather than sorting every frame, the locality of the storage order is measured
+* every few frames and the particles are only re-sorted once it has degraded.
+*/
+class SpatialSorter {
+public:
+	SpatialSorter();
+
+	// number of frames between locality checks
+	int checkInterval;
+	// how much worse than just after a sort the locality can get before re-sorting
+	float threshold;
+
+	// called once a frame, re-sorts the pool if it's due. returns true if it sorted.
+	bool update(ParticlePool &pool);
+
+	// sorts the pool by morton code straight away
+	void sort(ParticlePool &pool);
+
+	// average squared distance between particles next to each other in storage
+	// (sampled, lower is better)
+	float locality(ParticlePool &pool);
+
+	// sets the box particles are sorted within, as its lowest corner and its size
+	// along the longest axis
+	void setBounds(Point3D min, float size);
+
+	// 30-bit morton code for a point inside the box
+	uint32_t mortonCode(Point3D p);
+
+private:
+	// bounds of the box particles live in
+	float boxMin[3];
+	float boxSize;
+
+	// frames since the last locality check
+	int frames;
+	// locality measured just after the last sort
+	float sortedLocality;
+};
+
+#endif
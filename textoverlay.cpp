@@ -0,0 +1,46 @@
+#ifdef __APPLE__
+  #include <OpenGL/gl.h>
+  #include <GLUT/glut.h>
+#else
+  #include <GL/gl.h>
+  #include <GL/freeglut.h>
+#endif
+
+#include "textoverlay.h"
+
+TextOverlay::TextOverlay(void *font) {
+	this->font = font;
+	this->list = 0;
+	this->dirty = true;
+	// room for most overlays, so changing the text doesn't normally need the heap
+	this->text.reserve(256);
+}
+
+void TextOverlay::setText(const char *text) {
+	if (this->text == text) return;
+	// assigning reuses the string's storage when the new text fits
+	this->text = text;
+	this->dirty = true;
+}
+
+void TextOverlay::setText(const std::string &text) {
+	setText(text.c_str());
+}
+
+const std::string& TextOverlay::getText() {
+	return this->text;
+}
+
+void TextOverlay::draw() {
+	if (this->list == 0) this->list = glGenLists(1);
+
+	// recompile the glyphs only when the text has changed
+	if (this->dirty) {
+		glNewList(this->list, GL_COMPILE);
+		glutBitmapString(this->font, reinterpret_cast<const unsigned char *>(this->text.c_str()));
+		glEndList();
+		this->dirty = false;
+	}
+
+	glCallList(this->list);
+}
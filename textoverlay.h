@@ -0,0 +1,34 @@
+#ifndef TEXTOVERLAY_H
+#define TEXTOVERLAY_H
+
+#include <string>
+
+/**
+* A block of bitmap text which is compiled into a display list, so the glyphs are
+* only rasterized again when the text actually changes rather than every frame.
+*/
+class TextOverlay {
+public:
+	// font is one of the GLUT bitmap fonts, e.g. GLUT_BITMAP_HELVETICA_18
+	TextOverlay(void *font);
+
+	// changes the text. nothing is rebuilt if it's the same as before.
+	void setText(const char *text);
+	void setText(const std::string &text);
+
+	// draws the text at the current raster position
+	void draw();
+
+	// the text currently shown
+	const std::string& getText();
+
+private:
+	void *font;
+	std::string text;
+
+	// display list holding the glyphs (0 until first drawn), and whether it's out of date
+	unsigned int list;
+	bool dirty;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifdef __APPLE__
+  #include <OpenGL/gl.h>
+#else
+  #include <GL/gl.h>
+#endif
+
+#include "mathLib3D.h"
+#include "camera.h"
+#include "radixsort.h"
+#include "transparentpass.h"
+#include "framearena.h"
+#include "allocstats.h"
+
+TransparentPass::TransparentPass() {}
+
+void TransparentPass::clear() {
+	this->positions.clear();
+	this->sizes.clear();
+	this->colors.clear();
+}
+
+void TransparentPass::add(Point3D position, float size, float r, float g, float b, float a) {
+	this->positions.push_back(position);
+	this->sizes.push_back(size);
+	this->colors.push_back(r);
+	this->colors.push_back(g);
+	this->colors.push_back(b);
+	this->colors.push_back(a);
+}
+
+int TransparentPass::size() {
+	return this->positions.size();
+}
+
+void TransparentPass::reserve(int count) {
+	if (count > (int)this->positions.capacity()) countGrowth();
+	this->positions.reserve(count);
+	this->sizes.reserve(count);
+	this->colors.reserve(count * 4);
+	// and the quads they're drawn as, 4 corners each
+	this->vertexArray.reserve(count * 12);
+	this->colorArray.reserve(count * 16);
+}
+
+void TransparentPass::draw(Camera &camera, int screenHeight) {
+	int n = this->positions.size();
+	if (n == 0) return;
+
+	// depth of each point along the view direction. the key is the negated depth
+	// so the farthest points sort first.
+	// depths, keys and order are scratch for this frame only
+	FrameArena &arena = threadArena();
+	float *depths = (float*)arena.allocate(n * sizeof(float), alignof(float));
+	uint32_t *keys = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *order = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *keyScratch = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+	uint32_t *orderScratch = (uint32_t*)arena.allocate(n * sizeof(uint32_t), alignof(uint32_t));
+
+	// the camera's cached basis: the rows of the view matrix are its right, up and backwards vectors
+	const float *view = camera.viewMatrix();
+	Vec3D right = Vec3D(view[0], view[4], view[8]);
+	Vec3D up = Vec3D(view[1], view[5], view[9]);
+	Vec3D front = Vec3D(-view[2], -view[6], -view[10]);
+	for (int i = 0; i < n; i++) {
+		Point3D p = this->positions[i];
+		depths[i] = ((p.mX - camera.camPos.mX) * front.mX) + ((p.mY - camera.camPos.mY) * front.mY) + ((p.mZ - camera.camPos.mZ) * front.mZ);
+		keys[i] = floatKey(-depths[i]);
+		order[i] = i;
+	}
+	radixSort(keys, order, keyScratch, orderScratch, n, 32);
+
+	// the perspective is set up with a 90 degree fov, so at depth d the screen is 2d units high.
+	// this converts a size in pixels at depth 1 into half a quad width in world units.
+	float pixelScale = 1.0 / screenHeight;
+
+	this->vertexArray.resize(n * 12);
+	this->colorArray.resize(n * 16);
+	for (int i = 0; i < n; i++) {
+		int j = order[i];
+		Point3D p = this->positions[j];
+		float half = this->sizes[j] * depths[j] * pixelScale;
+
+		// right and up face each quad towards the camera
+		float rX = right.mX * half, rY = right.mY * half, rZ = right.mZ * half;
+		float uX = up.mX * half, uY = up.mY * half, uZ = up.mZ * half;
+
+		float *v = &this->vertexArray[i * 12];
+		v[0] = p.mX - rX - uX; v[1] = p.mY - rY - uY; v[2] = p.mZ - rZ - uZ;
+		v[3] = p.mX + rX - uX; v[4] = p.mY + rY - uY; v[5] = p.mZ + rZ - uZ;
+		v[6] = p.mX + rX + uX; v[7] = p.mY + rY + uY; v[8] = p.mZ + rZ + uZ;
+		v[9] = p.mX - rX + uX; v[10] = p.mY - rY + uY; v[11] = p.mZ - rZ + uZ;
+
+		float *c = &this->colorArray[i * 16];
+		for (int k = 0; k < 4; k++) {
+			c[(k * 4) + 0] = this->colors[(j * 4) + 0];
+			c[(k * 4) + 1] = this->colors[(j * 4) + 1];
+			c[(k * 4) + 2] = this->colors[(j * 4) + 2];
+			c[(k * 4) + 3] = this->colors[(j * 4) + 3];
+		}
+	}
+
+	// translucent geometry is still hidden behind opaque geometry,
+	// but doesn't write depth so it can't hide other translucent geometry.
+	glDepthMask(GL_FALSE);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, this->vertexArray.data());
+	glColorPointer(4, GL_FLOAT, 0, this->colorArray.data());
+
+	glDrawArrays(GL_QUADS, 0, n * 4);
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDepthMask(GL_TRUE);
+}
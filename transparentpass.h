@@ -0,0 +1,46 @@
+#ifndef TRANSPARENTPASS_H
+#define TRANSPARENTPASS_H
+
+#include "mathLib3D.h"
+#include "camera.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+* Collects translucent points during a frame and draws them at the end, sorted
+* back to front by their depth from the camera so alpha blending comes out right
+* regardless of what order the points were added in.
+* Points are drawn as camera facing quads so they can all go in one draw call
+* even though they have different sizes.
+*/
+class TransparentPass {
+public:
+	TransparentPass();
+
+	// forgets all points added so far (storage is kept for the next frame)
+	void clear();
+
+	// adds a point of the given size in pixels and RGBA colour
+	void add(Point3D position, float size, float r, float g, float b, float a);
+
+	// number of points added since the last clear
+	int size();
+
+	// makes room for count points, so adding and drawing them won't allocate
+	void reserve(int count);
+
+	// sorts and draws every point, for a viewport screenHeight pixels high
+	void draw(Camera &camera, int screenHeight);
+
+private:
+	// position/size/colour of each point added this frame
+	std::vector<Point3D> positions;
+	std::vector<float> sizes;
+	std::vector<float> colors;
+
+	// vertex and colour arrays passed to GL
+	std::vector<float> vertexArray;
+	std::vector<float> colorArray;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "particle3d.h"
+#include "transport.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+Ring::Ring() {
+	this->head.store(0);
+	this->tail.store(0);
+}
+
+size_t Ring::bytes() {
+	// round up to a cache line so rings placed one after another don't share one
+	return (sizeof(Ring) + 63) & ~(size_t)63;
+}
+
+bool Ring::push(const Particle3D &p) {
+	uint32_t h = this->head.load(std::memory_order_relaxed);
+	if (h - this->tail.load(std::memory_order_acquire) == CAPACITY) return false;
+	memcpy(this->slots[h & (CAPACITY - 1)], &p, sizeof(p));
+	// publish the particle only once it has been written
+	this->head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+bool Ring::pop(Particle3D &p) {
+	uint32_t t = this->tail.load(std::memory_order_relaxed);
+	if (t == this->head.load(std::memory_order_acquire)) return false;
+	memcpy(&p, this->slots[t & (CAPACITY - 1)], sizeof(p));
+	this->tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+RingTransport::RingTransport(Ring *out, Ring *in) {
+	this->out = out;
+	this->in = in;
+}
+
+bool RingTransport::send(const Particle3D &p) {
+	return this->out->push(p);
+}
+
+bool RingTransport::receive(Particle3D &p) {
+	return this->in->pop(p);
+}
+
+SocketTransport::SocketTransport(int fd) {
+	this->fd = fd;
+}
+
+SocketTransport::~SocketTransport() {
+	close(this->fd);
+}
+
+bool SocketTransport::send(const Particle3D &p) {
+	return ::send(this->fd, &p, sizeof(p), MSG_DONTWAIT) == sizeof(p);
+}
+
+bool SocketTransport::receive(Particle3D &p) {
+	return recv(this->fd, &p, sizeof(p), MSG_DONTWAIT) == sizeof(p);
+}
@@ -0,0 +1,77 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "particle3d.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+* A two way link to a neighbouring process which particles can be passed along.
+* Both calls never block: send returns false if the link is full (the caller
+* keeps the particle and tries again later), receive returns false once there
+* is nothing waiting.
+*/
+class Transport {
+public:
+	virtual ~Transport() {}
+	virtual bool send(const Particle3D &p) = 0;
+	virtual bool receive(Particle3D &p) = 0;
+};
+
+/**
+* Single producer/single consumer queue of particles, which lives in memory shared
+* between two processes. Construct it in place with new (memory) Ring().
+*/
+class Ring {
+public:
+	// particles the ring can hold (must be a power of 2)
+	static const uint32_t CAPACITY = 4096;
+
+	Ring();
+
+	bool push(const Particle3D &p);
+	bool pop(Particle3D &p);
+
+	// bytes needed for one ring
+	static size_t bytes();
+
+private:
+	// next slot to write and next slot to read. these only ever increase, and wrap around the slots.
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	// raw storage, so placing a ring doesn't construct (and randomize) every particle
+	unsigned char slots[CAPACITY][sizeof(Particle3D)];
+};
+
+/**
+* Link made from a pair of shared memory rings, one in each direction.
+*/
+class RingTransport : public Transport {
+public:
+	RingTransport(Ring *out, Ring *in);
+	bool send(const Particle3D &p);
+	bool receive(Particle3D &p);
+
+private:
+	Ring *out;
+	Ring *in;
+};
+
+/**
+* Link over one end of a local datagram socket, one particle per datagram.
+* The same protocol could run over a network socket to a process on another machine.
+*/
+class SocketTransport : public Transport {
+public:
+	// takes ownership of the socket
+	SocketTransport(int fd);
+	~SocketTransport();
+	bool send(const Particle3D &p);
+	bool receive(Particle3D &p);
+
+private:
+	int fd;
+};
+
+#endif
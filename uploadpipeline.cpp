@@ -0,0 +1,279 @@
+#ifdef __APPLE__
+  #include <OpenGL/gl.h>
+  #include <GLUT/glut.h>
+#else
+  #include <GL/gl.h>
+  #include <GL/glext.h>
+  #include <GL/freeglut.h>
+#endif
+
+#include "particle3d.h"
+#include "particlepool.h"
+#include "transparentpass.h"
+#include "uploadpipeline.h"
+#include "metrics.h"
+#include "allocstats.h"
+#include <string.h>
+#include <chrono>
+
+#ifndef __APPLE__
+// GL functions needed for persistent mapping, looked up at runtime since they're not in GL 1.1
+static PFNGLGENBUFFERSPROC genBuffers = NULL;
+static PFNGLDELETEBUFFERSPROC deleteBuffers = NULL;
+static PFNGLBINDBUFFERPROC bindBuffer = NULL;
+static PFNGLBUFFERSTORAGEPROC bufferStorage = NULL;
+static PFNGLMAPBUFFERRANGEPROC mapBufferRange = NULL;
+static PFNGLUNMAPBUFFERPROC unmapBuffer = NULL;
+static PFNGLFENCESYNCPROC fenceSync = NULL;
+static PFNGLCLIENTWAITSYNCPROC clientWaitSync = NULL;
+static PFNGLDELETESYNCPROC deleteSync = NULL;
+
+// flags for mapping the buffers once and keeping them mapped
+static const GLbitfield MAP_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+#endif
+
+UploadPipeline::UploadPipeline() {
+	for (int i = 0; i < SLOTS; i++) {
+		this->slots[i].buffer = 0;
+		this->slots[i].mapped = NULL;
+		this->slots[i].fence = NULL;
+		this->slots[i].count = 0;
+	}
+	this->capacity = 0;
+	this->writeSlot = -1;
+	this->readySlot = -1;
+	this->initialized = false;
+	this->usePersistent = false;
+	this->source = NULL;
+	this->busy = false;
+	this->quit = false;
+	this->fillMetric = -1;
+}
+
+void UploadPipeline::setFillMetric(int histogram) {
+	this->fillMetric = histogram;
+}
+
+UploadPipeline::~UploadPipeline() {
+	if (!this->initialized) return;
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->quit = true;
+	}
+	this->wake.notify_all();
+	this->worker.join();
+}
+
+void UploadPipeline::init() {
+	if (this->initialized) return;
+	this->initialized = true;
+
+#ifndef __APPLE__
+	// persistent mapping needs GL 4.4 or the buffer storage extension
+	const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+	const char *version = (const char*)glGetString(GL_VERSION);
+	bool supported = (extensions != NULL && strstr(extensions, "GL_ARB_buffer_storage") != NULL)
+		|| (version != NULL && (version[0] > '4' || (version[0] == '4' && version[2] >= '4')));
+	if (supported) {
+		genBuffers = (PFNGLGENBUFFERSPROC)glutGetProcAddress("glGenBuffers");
+		deleteBuffers = (PFNGLDELETEBUFFERSPROC)glutGetProcAddress("glDeleteBuffers");
+		bindBuffer = (PFNGLBINDBUFFERPROC)glutGetProcAddress("glBindBuffer");
+		bufferStorage = (PFNGLBUFFERSTORAGEPROC)glutGetProcAddress("glBufferStorage");
+		mapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glutGetProcAddress("glMapBufferRange");
+		unmapBuffer = (PFNGLUNMAPBUFFERPROC)glutGetProcAddress("glUnmapBuffer");
+		fenceSync = (PFNGLFENCESYNCPROC)glutGetProcAddress("glFenceSync");
+		clientWaitSync = (PFNGLCLIENTWAITSYNCPROC)glutGetProcAddress("glClientWaitSync");
+		deleteSync = (PFNGLDELETESYNCPROC)glutGetProcAddress("glDeleteSync");
+		this->usePersistent = genBuffers && deleteBuffers && bindBuffer && bufferStorage && mapBufferRange
+			&& unmapBuffer && fenceSync && clientWaitSync && deleteSync;
+	}
+#endif
+
+	this->worker = std::thread(&UploadPipeline::run, this);
+}
+
+bool UploadPipeline::persistent() {
+	return this->usePersistent;
+}
+
+void UploadPipeline::waitForSlot(Slot &slot) {
+#ifndef __APPLE__
+	if (slot.fence == NULL) return;
+	// flush on the first wait, so the fence is guaranteed to signal eventually
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (clientWaitSync((GLsync)slot.fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) flags = 0;
+	deleteSync((GLsync)slot.fence);
+	slot.fence = NULL;
+#endif
+}
+
+void UploadPipeline::reserve(int count) {
+	if (count <= this->capacity) return;
+	countGrowth();
+	// grow with room to spare, so this only happens while the particle count is climbing
+	int newCapacity = this->capacity == 0 ? 4096 : this->capacity;
+	while (newCapacity < count) newCapacity *= 2;
+
+	for (int i = 0; i < SLOTS; i++) {
+		Slot &slot = this->slots[i];
+		// every particle could have a halo
+		slot.halos.reserve(newCapacity * 4);
+		if (!this->usePersistent) {
+			slot.vertices.resize(newCapacity * VERTEX_FLOATS);
+			continue;
+		}
+#ifndef __APPLE__
+		// buffer storage can't be resized, so replace the buffer
+		waitForSlot(slot);
+		if (slot.buffer != 0) {
+			bindBuffer(GL_ARRAY_BUFFER, slot.buffer);
+			unmapBuffer(GL_ARRAY_BUFFER);
+			deleteBuffers(1, &slot.buffer);
+		}
+		GLsizeiptr bytes = sizeof(float) * newCapacity * VERTEX_FLOATS;
+		genBuffers(1, &slot.buffer);
+		bindBuffer(GL_ARRAY_BUFFER, slot.buffer);
+		bufferStorage(GL_ARRAY_BUFFER, bytes, NULL, MAP_FLAGS);
+		slot.mapped = (float*)mapBufferRange(GL_ARRAY_BUFFER, 0, bytes, MAP_FLAGS);
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+	}
+	this->capacity = newCapacity;
+	// any slot ready to draw was just thrown away
+	this->readySlot = -1;
+}
+
+void UploadPipeline::begin(ParticlePool &pool) {
+	// nothing to upload to without a GL context
+	if (!this->initialized) return;
+	finish();
+	// sized on the pool's capacity so these only grow when the pool does
+	reserve(pool.capacity());
+
+	// write into the slot after the one about to be drawn, once the GPU is done with it
+	this->writeSlot = (this->readySlot + 1) % SLOTS;
+	waitForSlot(this->slots[this->writeSlot]);
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->source = &pool;
+		this->busy = true;
+	}
+	this->wake.notify_all();
+}
+
+void UploadPipeline::finish() {
+	if (this->writeSlot < 0) return;
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->wake.wait(guard, [this] { return !this->busy; });
+	this->readySlot = this->writeSlot;
+	this->writeSlot = -1;
+}
+
+void UploadPipeline::run() {
+	std::unique_lock<std::mutex> guard(this->lock);
+	while (true) {
+		this->wake.wait(guard, [this] { return this->busy || this->quit; });
+		if (this->quit) return;
+
+		// fill the slot without holding the lock
+		guard.unlock();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		fill(this->slots[this->writeSlot], *this->source);
+		if (Metrics::shared().running()) {
+			Metrics::shared().observe(this->fillMetric, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		guard.lock();
+
+		this->busy = false;
+		this->wake.notify_all();
+	}
+}
+
+void UploadPipeline::fill(Slot &slot, ParticlePool &pool) {
+	float *out = this->usePersistent ? slot.mapped : slot.vertices.data();
+	int n = pool.size();
+
+	// count particles of each size, and work out where each size starts
+	for (int s = 0; s < MAX_POINT_SIZE; s++) slot.sizeCounts[s] = 0;
+	for (int i = 0; i < n; i++) {
+		int size = pool[i].size;
+		if (size < 1) size = 1;
+		if (size >= MAX_POINT_SIZE) size = MAX_POINT_SIZE - 1;
+		slot.sizeCounts[size]++;
+	}
+	int offsets[MAX_POINT_SIZE];
+	int total = 0;
+	for (int s = 0; s < MAX_POINT_SIZE; s++) {
+		offsets[s] = total;
+		total += slot.sizeCounts[s];
+	}
+
+	// write every vertex into its size's run, and note the halos
+	slot.halos.clear();
+	for (int i = 0; i < n; i++) {
+		Particle3D &p = pool[i];
+		int size = p.size;
+		if (size < 1) size = 1;
+		if (size >= MAX_POINT_SIZE) size = MAX_POINT_SIZE - 1;
+
+		float *v = out + (offsets[size]++ * VERTEX_FLOATS);
+		v[0] = p.position.mX;
+		v[1] = p.position.mY;
+		v[2] = p.position.mZ;
+		v[3] = p.color[0];
+		v[4] = p.color[1];
+		v[5] = p.color[2];
+
+		if (p.halo) {
+			slot.halos.push_back(p.position.mX);
+			slot.halos.push_back(p.position.mY);
+			slot.halos.push_back(p.position.mZ);
+			slot.halos.push_back(p.size);
+		}
+	}
+	slot.count = n;
+}
+
+void UploadPipeline::draw(TransparentPass &halos) {
+	if (this->readySlot < 0) return;
+	Slot &slot = this->slots[this->readySlot];
+
+	// vertex data comes from the slot's buffer, or straight from its array
+	const float *base = slot.vertices.data();
+#ifndef __APPLE__
+	if (this->usePersistent) {
+		bindBuffer(GL_ARRAY_BUFFER, slot.buffer);
+		base = NULL;
+	}
+#endif
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, VERTEX_FLOATS * sizeof(float), base);
+	glColorPointer(3, GL_FLOAT, VERTEX_FLOATS * sizeof(float), base + 3);
+
+	// one draw call per point size
+	int first = 0;
+	for (int s = 0; s < MAX_POINT_SIZE; s++) {
+		if (slot.sizeCounts[s] == 0) continue;
+		glPointSize(s);
+		glDrawArrays(GL_POINTS, first, slot.sizeCounts[s]);
+		first += slot.sizeCounts[s];
+	}
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+
+#ifndef __APPLE__
+	if (this->usePersistent) {
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+		// the slot can't be written again until the GPU has passed this point
+		if (slot.fence != NULL) deleteSync((GLsync)slot.fence);
+		slot.fence = fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+#endif
+
+	for (int i = 0; i < (int)slot.halos.size(); i += 4) {
+		halos.add(Point3D(slot.halos[i], slot.halos[i + 1], slot.halos[i + 2]), slot.halos[i + 3] + 5, 1.0, 0.0, 0.0, 0.3);
+	}
+}
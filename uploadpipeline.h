@@ -0,0 +1,102 @@
+#ifndef UPLOADPIPELINE_H
+#define UPLOADPIPELINE_H
+
+#include "particlepool.h"
+#include "transparentpass.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Copies particle vertex data for drawing on a worker thread, one frame ahead of the draw.
+*
+* Vertex data goes round a ring of 3 slots: while the frame in one slot is being drawn,
+* the worker fills the next one. When the driver supports persistently mapped buffers
+* (GL_ARB_buffer_storage) the slots are GL buffers written in place, with fences making
+* sure a slot is never overwritten while the GPU might still be reading it. Otherwise
+* the slots are plain client side arrays.
+*
+* Particles are grouped by point size so each size can be drawn with one call.
+*/
+class UploadPipeline {
+public:
+	UploadPipeline();
+	~UploadPipeline();
+
+	// picks the buffer type and starts the worker thread. needs a current GL context.
+	void init();
+
+	// hands the particles to the worker to be written into the next slot (does nothing
+	// before init). the particles must not change until finish() has been called.
+	void begin(ParticlePool &pool);
+
+	// waits for the worker to finish writing, after which the particles can change again
+	// and the new slot is the one drawn. does nothing if no upload is in progress.
+	void finish();
+
+	// draws the particles in the most recently finished slot, and queues their halos
+	void draw(TransparentPass &halos);
+
+	// whether persistently mapped GL buffers are being used
+	bool persistent();
+
+	// histogram (see Metrics) the worker records how long each upload takes in
+	void setFillMetric(int histogram);
+
+private:
+	// number of slots in the ring
+	static const int SLOTS = 3;
+	// floats per vertex: x, y, z, r, g, b
+	static const int VERTEX_FLOATS = 6;
+	// point sizes are clamped below this so they can be bucketed
+	static const int MAX_POINT_SIZE = 64;
+
+	class Slot {
+	public:
+		// client side vertex storage (when not persistent)
+		std::vector<float> vertices;
+		// GL buffer, where it's mapped, and the fence placed after it was last drawn
+		unsigned int buffer;
+		float *mapped;
+		void *fence;
+
+		// number of particles of each size, in the order they were written
+		int sizeCounts[MAX_POINT_SIZE];
+		int count;
+
+		// x, y, z and size of each particle with a halo
+		std::vector<float> halos;
+	};
+
+	Slot slots[SLOTS];
+	// particles each slot can hold
+	int capacity;
+	// slot being written by the worker, and the last slot finished (-1 if none yet)
+	int writeSlot;
+	int readySlot;
+
+	bool initialized;
+	bool usePersistent;
+
+	// worker thread, and what it's been asked to do
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	ParticlePool *source;
+	bool busy;
+	bool quit;
+	// metrics histogram for upload times, -1 if not recorded
+	int fillMetric;
+
+	// makes every slot hold at least count particles
+	void reserve(int count);
+	// waits for the GPU to be done with a slot
+	void waitForSlot(Slot &slot);
+	// writes the particles into a slot (on the worker thread)
+	void fill(Slot &slot, ParticlePool &pool);
+	// the worker thread's loop
+	void run();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "framearena.h"
+#include "workerpool.h"
+#include <unistd.h>
+
+WorkerPool::WorkerPool(int threads) {
+	this->task = NULL;
+	this->arg = NULL;
+	this->count = 0;
+	this->generation = 0;
+	this->next.store(0);
+	this->remaining = 0;
+	this->active = 0;
+	this->quit = false;
+	this->owner = getpid();
+
+	for (int i = 1; i < threads; i++) {
+		this->threads.push_back(std::thread(&WorkerPool::loop, this));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->quit = true;
+	}
+	this->wake.notify_all();
+	// a forked child has copies of the thread handles but not the threads themselves
+	if (getpid() != this->owner) {
+		for (int i = 0; i < this->threads.size(); i++) this->threads[i].detach();
+		return;
+	}
+	for (int i = 0; i < this->threads.size(); i++) this->threads[i].join();
+}
+
+int WorkerPool::size() {
+	return this->threads.size() + 1;
+}
+
+WorkerPool& WorkerPool::shared() {
+	static WorkerPool pool(std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1);
+	return pool;
+}
+
+void WorkerPool::work() {
+	int done = 0;
+	int i;
+	while ((i = this->next.fetch_add(1)) < this->count) {
+		this->task(i, this->arg);
+		done++;
+	}
+
+	if (done > 0) {
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->remaining -= done;
+	}
+}
+
+void WorkerPool::run(Task task, void *arg, int count) {
+	// in a forked child (or with no workers) just run everything here
+	if (this->threads.empty() || getpid() != this->owner) {
+		for (int i = 0; i < count; i++) task(i, arg);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> guard(this->lock);
+		// a worker which woke up late for the last job may still be looking at it
+		this->finished.wait(guard, [this] { return this->active == 0; });
+		this->task = task;
+		this->arg = arg;
+		this->count = count;
+		this->remaining = count;
+		this->next.store(0);
+		this->generation++;
+	}
+	this->wake.notify_all();
+
+	// help out, then wait for the stragglers
+	work();
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->finished.wait(guard, [this] { return this->remaining == 0 && this->active == 0; });
+}
+
+void WorkerPool::loop() {
+	int seen = 0;
+	std::unique_lock<std::mutex> guard(this->lock);
+	while (true) {
+		this->wake.wait(guard, [this, seen] { return this->quit || this->generation != seen; });
+		if (this->quit) return;
+		seen = this->generation;
+		this->active++;
+
+		guard.unlock();
+		work();
+		// scratch memory used by the tasks only lasts until they're done
+		threadArena().reset();
+		guard.lock();
+
+		this->active--;
+		if (this->active == 0) this->finished.notify_all();
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Fixed set of threads which parallel loops are run on, so they don't pay for
+* starting threads (and allocating their state) every time.
+*/
+class WorkerPool {
+public:
+	// a task is called once for each index from 0 to count - 1
+	typedef void (*Task)(int index, void *arg);
+
+	// starts threads - 1 worker threads (the thread calling run does work too)
+	WorkerPool(int threads);
+	~WorkerPool();
+
+	// runs task for every index across all threads, returning once they're all done
+	void run(Task task, void *arg, int count);
+
+	// number of threads work is split across, including the caller
+	int size();
+
+	// pool shared by the whole program, with a thread per core
+	static WorkerPool& shared();
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable finished;
+
+	// current job. generation changes each time a job starts.
+	Task task;
+	void *arg;
+	int count;
+	int generation;
+	std::atomic<int> next;
+	int remaining;
+	// workers currently inside a job, which has to be 0 before the next job starts
+	int active;
+	bool quit;
+
+	// process that started the threads. a forked child doesn't have them.
+	pid_t owner;
+
+	// takes indices from the current job until there are none left
+	void work();
+	// loop run by each worker thread
+	void loop();
+};
+
+#endif